@@ -0,0 +1,91 @@
+"""ctypes binding of src/libcachesim.so (build with `make lib`).
+
+Example:
+    sim = CacheSim(8, 8, 'LRU', 'back_alloc')
+    flags = sim.access(addrs, is_read)      # NumPy arrays, no copies
+    print(sim.counters()['read miss'])
+"""
+import ctypes
+import os
+
+import numpy as np
+
+LOG_HIT = 0x01
+LOG_READ_MEM = 0x02
+LOG_WRITE_MEM = 0x04
+LOG_REPLACE = 0x08
+
+COUNTER_NAMES = [
+    'access count', 'read count', 'write count', 'read miss', 'write miss',
+    'write mem count', 'read mem count', 'cache space', 'replace space',
+    'read mem bytes', 'write mem bytes',
+]
+
+_lib_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'src', 'libcachesim.so')
+_lib = ctypes.CDLL(_lib_path)
+
+_u64_p = ctypes.POINTER(ctypes.c_uint64)
+_u8_p = ctypes.POINTER(ctypes.c_uint8)
+
+_lib.cachesim_create.restype = ctypes.c_void_p
+_lib.cachesim_create.argtypes = [ctypes.c_uint64, ctypes.c_uint64, ctypes.c_char_p, ctypes.c_char_p]
+_lib.cachesim_destroy.argtypes = [ctypes.c_void_p]
+_lib.cachesim_access_batch.argtypes = [ctypes.c_void_p, _u64_p, _u8_p, ctypes.c_uint64, _u8_p]
+_lib.cachesim_get_counters.argtypes = [ctypes.c_void_p, _u64_p, ctypes.c_uint64]
+_lib.cachesim_set_keep_log.argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.cachesim_log_size.restype = ctypes.c_uint64
+_lib.cachesim_log_size.argtypes = [ctypes.c_void_p]
+_lib.cachesim_read_log.restype = ctypes.c_uint64
+_lib.cachesim_read_log.argtypes = [ctypes.c_void_p, ctypes.c_uint64, _u8_p, ctypes.c_uint64]
+_lib.cachesim_clear_log.argtypes = [ctypes.c_void_p]
+
+
+class CacheSim:
+    def __init__(self, block_size, ways, replace, write, keep_log=True):
+        self._sim = _lib.cachesim_create(block_size, ways, replace.encode(), write.encode())
+        if not self._sim:
+            raise ValueError(f'invalid cache configuration: {block_size} {ways} {replace} {write}')
+        _lib.cachesim_set_keep_log(self._sim, int(keep_log))
+
+    def __del__(self):
+        if getattr(self, '_sim', None):
+            _lib.cachesim_destroy(self._sim)
+            self._sim = None
+
+    def access(self, addrs, is_read):
+        """Simulates a batch; returns the per-access flags as a uint8 array."""
+        addrs = np.ascontiguousarray(addrs, dtype=np.uint64)
+        is_read = np.ascontiguousarray(is_read, dtype=np.uint8)
+        assert addrs.shape == is_read.shape
+        flags = np.empty(len(addrs), dtype=np.uint8)
+        ret = _lib.cachesim_access_batch(
+            self._sim, addrs.ctypes.data_as(_u64_p), is_read.ctypes.data_as(_u8_p),
+            len(addrs), flags.ctypes.data_as(_u8_p))
+        if ret != 0:
+            raise RuntimeError(f'cachesim_access_batch failed: {ret}')
+        return flags
+
+    def counters(self):
+        out = np.zeros(len(COUNTER_NAMES), dtype=np.uint64)
+        _lib.cachesim_get_counters(self._sim, out.ctypes.data_as(_u64_p), len(out))
+        return dict(zip(COUNTER_NAMES, (int(x) for x in out)))
+
+    def log(self):
+        n = _lib.cachesim_log_size(self._sim)
+        out = np.empty(n, dtype=np.uint8)
+        _lib.cachesim_read_log(self._sim, 0, out.ctypes.data_as(_u8_p), n)
+        return out
+
+    def clear_log(self):
+        _lib.cachesim_clear_log(self._sim)
+
+
+def read_trace(filename):
+    """Reads a .trace file into (addrs, is_read) arrays."""
+    addrs, is_read = [], []
+    with open(filename) as f:
+        for line in f:
+            a, cmd = line.split()
+            addrs.append(int(a, 2))
+            is_read.append(cmd == 'r')
+    return np.array(addrs, dtype=np.uint64), np.array(is_read, dtype=np.uint8)
@@ -0,0 +1,167 @@
+import argparse
+import os
+import struct
+import sys
+
+# Result store written by the simulator, format in src/resultStore.hpp
+default_db = "output/results.db"
+magic = b"CSRSLT1\0"
+header = struct.Struct("<8sQqIQ")
+
+
+def read_segments(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+    pos = 0
+    while pos + header.size <= len(data):
+        tag, size, time, ncols, nrows = header.unpack_from(data, pos)
+        if tag != magic or size < header.size or pos + size > len(data):
+            # Truncated by an interrupted run
+            print(f"{filename}: ignoring bytes from offset {pos}", file=sys.stderr)
+            break
+        p = pos + header.size
+        columns = []
+        for _ in range(ncols):
+            end = data.index(b"\0", p)
+            columns.append((data[p:end].decode(), chr(data[end + 1])))
+            p = end + 2
+        values = {}
+        for name, kind in columns:
+            if kind == "S":
+                col = []
+                for _ in range(nrows):
+                    end = data.index(b"\0", p)
+                    col.append(data[p:end].decode())
+                    p = end + 1
+            else:
+                col = list(struct.unpack_from(f"<{nrows}{'q' if kind == 'L' else 'd'}", data, p))
+                p += 8 * nrows
+            values[name] = col
+        rows = [{name: values[name][r] for name, _ in columns} for r in range(nrows)]
+        yield time, rows
+        pos += size
+
+
+def read_store(filename=default_db, history=False):
+    """Rows of the store as dicts. Unless history is set, a configuration
+    appended several times keeps only its latest rows."""
+    latest = {}
+    for time, rows in read_segments(filename):
+        if not rows:
+            continue
+        key = rows[0]["config"]
+        if history:
+            key = (key, len(latest))
+        latest.pop(key, None)
+        latest[key] = rows
+    return [row for rows in latest.values() for row in rows]
+
+
+def parse_value(s):
+    for conv in (int, float):
+        try:
+            return conv(s)
+        except ValueError:
+            pass
+    return s
+
+
+def make_filter(expr):
+    for op in ("!=", ">=", "<=", "=", ">", "<"):
+        if op in expr:
+            name, val = expr.split(op, 1)
+            name, val = name.strip(), parse_value(val.strip())
+            break
+    else:
+        sys.exit(f"invalid filter: {expr}")
+
+    def test(row):
+        if name not in row:
+            return False
+        x = row[name]
+        if isinstance(val, str) != isinstance(x, str):
+            x, v = str(x), str(val)
+        else:
+            v = val
+        return {"=": x == v, "!=": x != v, ">": x > v, "<": x < v,
+                ">=": x >= v, "<=": x <= v}[op]
+    return test
+
+
+def fmt(x):
+    if isinstance(x, float):
+        return f"{x:.2f}"
+    return str(x)
+
+
+def print_table(header, rows):
+    widths = [max(len(h), *(len(r[i]) for r in rows)) if rows else len(h)
+              for i, h in enumerate(header)]
+    print("  ".join(h.ljust(w) for h, w in zip(header, widths)))
+    for r in rows:
+        print("  ".join(c.ljust(w) for c, w in zip(r, widths)))
+
+
+def pivot(rows, row_key, col_key, value):
+    """Mean of value for every (row_key, col_key) pair, plus a mean column."""
+    cells = {}
+    row_vals, col_vals = [], []
+    for row in rows:
+        if value not in row or row_key not in row or col_key not in row:
+            continue
+        r, c = row[row_key], row[col_key]
+        if r not in row_vals:
+            row_vals.append(r)
+        if c not in col_vals:
+            col_vals.append(c)
+        cells.setdefault((r, c), []).append(row[value])
+    col_vals.sort(key=lambda c: (isinstance(c, str), c))
+    table = []
+    for r in row_vals:
+        line = [fmt(r)]
+        means = []
+        for c in col_vals:
+            v = cells.get((r, c))
+            if v:
+                means.append(sum(v) / len(v))
+                line.append(fmt(means[-1]))
+            else:
+                line.append("")
+        line.append(fmt(sum(means) / len(means)))
+        table.append(line)
+    print_table([row_key] + [fmt(c) for c in col_vals] + ["mean"], table)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Query the simulator result store")
+    parser.add_argument("--db", default=default_db)
+    parser.add_argument("--all", action="store_true",
+                        help="keep every append of a configuration, not just the latest")
+    parser.add_argument("--where", action="append", default=[], metavar="COL<op>VAL",
+                        help="filter rows, op is one of = != < > <= >=; repeatable")
+    parser.add_argument("--cols", help="comma separated columns to print")
+    parser.add_argument("--pivot", nargs=3, metavar=("ROW", "COL", "VALUE"),
+                        help="table of the mean VALUE per ROW and COL value")
+    parser.add_argument("--columns", action="store_true", help="list the column names")
+    args = parser.parse_args()
+
+    if not os.path.exists(args.db):
+        sys.exit(f"no result store at {args.db}")
+    rows = read_store(args.db, args.all)
+    for expr in args.where:
+        rows = list(filter(make_filter(expr), rows))
+
+    if args.columns:
+        names = []
+        for row in rows:
+            names += [n for n in row if n not in names]
+        print("\n".join(names))
+    elif args.pivot:
+        pivot(rows, *args.pivot)
+    else:
+        names = args.cols.split(",") if args.cols else ["config", "trace id", "miss rate"]
+        print_table(names, [[fmt(row.get(n, "")) for n in names] for row in rows])
+
+
+if __name__ == "__main__":
+    main()
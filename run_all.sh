@@ -1,3 +1,5 @@
-bash ./run_structure.sh
-bash ./run_replace.sh
-bash ./run_write.sh
\ No newline at end of file
+make build
+
+# Runs every configuration of the structure, replacement and write
+# experiments in parallel, longest jobs first
+cd src && ./main --grid ../experiments.grid
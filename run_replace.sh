@@ -2,6 +2,7 @@ replace_policy=(
     "binTree"
     "LRU"
     "PLRU"
+    "OPT"
 )
 
 for replace in ${replace_policy[@]}
@@ -1,11 +1,11 @@
 write_policies=(
     "back_alloc"
     "back_noAlloc"
-    "through_alloc"
-    "through_noAlloc"
 )
 
+# --fuse also reports through_alloc and through_noAlloc from the same runs
+cd src
 for write_policy in ${write_policies[@]}
 do
-    write_policy=$write_policy ./run.sh 
-done
\ No newline at end of file
+    ./main 8 8 binTree $write_policy --fuse
+done
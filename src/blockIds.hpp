@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <cassert>
+#include <algorithm>
+#include <functional>
+
+#include "global.hpp"
+#include "instr.hpp"
+
+using namespace std;
+
+const u32 RADIX_BITS = 8;
+const u32 RADIX_BUCKETS = 1 << RADIX_BITS;
+
+/*
+    Dense IDs for the blocks of a trace: every distinct block address at a
+    given block size gets a 32-bit ID, in increasing address order, and
+    ids holds the ID of every access. Shadow structures keyed by block
+    (OPT next use, first touch, the classifier's LRU shadow) can then be
+    flat vectors of size() entries instead of hash tables.
+
+    Built once per trace and block size, by sorting (block, access) pairs
+    with a parallel LSD radix sort and numbering the distinct blocks in a
+    parallel unique pass. Each thread takes a fixed chunk of the accesses;
+    per-chunk digit counts give every chunk its own output ranges, so
+    scattering needs no synchronisation and stays stable. Only the bytes
+    that vary across blocks are sorted on.
+*/
+class BlockIds {
+public:
+    u64 lenOffset;
+    vector<u32> ids;        // Per access
+    vector<u64> blocks;     // Per ID, ascending
+
+    BlockIds(const vector<Instr>& instrs, u64 lenOffset, int nThreads)
+    :
+        lenOffset(lenOffset)
+    {
+        u64 n = instrs.size();
+        assert(n < (1ull << 32));
+        if (n == 0) return;
+        nChunks = nThreads < 1 ? 1 : nThreads;
+        if ((u64) nChunks > n / 4096 + 1) nChunks = n / 4096 + 1;
+
+        vector<u64> keys(n);
+        vector<u32> order(n);
+        u64 varying = 0;
+        for (u64 i = 0; i < n; ++i) {
+            keys[i] = instrs[i].addr >> lenOffset;
+            order[i] = i;
+            varying |= keys[i] ^ keys[0];
+        }
+        radixSort(keys, order, varying);
+        number(keys, order);
+    }
+
+    u64 size() const {
+        return blocks.size();
+    }
+
+    u64 getNBytes() const {
+        return ids.size() * sizeof(u32) + blocks.size() * sizeof(u64);
+    }
+
+private:
+    int nChunks = 1;
+
+    void parallel(const function<void(int, u64, u64)>& work, u64 n) {
+        vector<thread> workers;
+        for (int c = 0; c < nChunks; ++c) {
+            u64 begin = n * c / nChunks;
+            u64 end = n * (c + 1) / nChunks;
+            workers.push_back(thread(work, c, begin, end));
+        }
+        for (thread& t : workers) t.join();
+    }
+
+    void radixSort(vector<u64>& keys, vector<u32>& order, u64 varying) {
+        u64 n = keys.size();
+        vector<u64> keysOut(n);
+        vector<u32> orderOut(n);
+        vector<u64> offsets(nChunks * RADIX_BUCKETS);
+        for (u32 shift = 0; shift < 64 && (varying >> shift) != 0; shift += RADIX_BITS) {
+            if (((varying >> shift) & (RADIX_BUCKETS - 1)) == 0) continue;
+            parallel([&](int c, u64 begin, u64 end) {
+                u64* count = &offsets[c * RADIX_BUCKETS];
+                fill(count, count + RADIX_BUCKETS, 0);
+                for (u64 i = begin; i < end; ++i) {
+                    count[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            }, n);
+            // Digit-major prefix sums, so chunk c writes after chunks < c
+            u64 total = 0;
+            for (u32 d = 0; d < RADIX_BUCKETS; ++d) {
+                for (int c = 0; c < nChunks; ++c) {
+                    u64 cnt = offsets[c * RADIX_BUCKETS + d];
+                    offsets[c * RADIX_BUCKETS + d] = total;
+                    total += cnt;
+                }
+            }
+            parallel([&](int c, u64 begin, u64 end) {
+                u64* next = &offsets[c * RADIX_BUCKETS];
+                for (u64 i = begin; i < end; ++i) {
+                    u64 pos = next[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                    keysOut[pos] = keys[i];
+                    orderOut[pos] = order[i];
+                }
+            }, n);
+            keys.swap(keysOut);
+            order.swap(orderOut);
+        }
+    }
+
+    // IDs of sorted keys: a block's ID is the number of distinct blocks
+    // before it, counted per chunk first
+    void number(const vector<u64>& keys, const vector<u32>& order) {
+        u64 n = keys.size();
+        ids.assign(n, 0);
+        vector<u64> firsts(nChunks + 1, 0);
+        parallel([&](int c, u64 begin, u64 end) {
+            for (u64 i = begin; i < end; ++i) {
+                firsts[c + 1] += (i == 0 || keys[i] != keys[i - 1]);
+            }
+        }, n);
+        for (int c = 0; c < nChunks; ++c) {
+            firsts[c + 1] += firsts[c];
+        }
+        blocks.assign(firsts[nChunks], 0);
+        parallel([&](int c, u64 begin, u64 end) {
+            u64 id = firsts[c];
+            for (u64 i = begin; i < end; ++i) {
+                if (i == 0 || keys[i] != keys[i - 1]) {
+                    blocks[id++] = keys[i];
+                }
+                ids[order[i]] = id - 1;
+            }
+        }, n);
+    }
+};
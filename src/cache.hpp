@@ -5,11 +5,22 @@
 #include <cassert>
 #include <fstream>
 #include <chrono>
+#include <functional>
 
 #include "global.hpp"
 #include "utils.hpp"
 #include "instr.hpp"
 #include "replacementManager.hpp"
+#include "missClassifier.hpp"
+#include "heavyHitters.hpp"
+#include "setStats.hpp"
+#include "prefetcher.hpp"
+#include "writeBuffer.hpp"
+#include "victimCache.hpp"
+#include "latencyModel.hpp"
+#include "windowStats.hpp"
+#include "sampling.hpp"
+#include "mshr.hpp"
 
 #define LOG_PROGRESS
 
@@ -17,6 +28,8 @@
 int log_step = 5000;
 #endif
 
+const u64 ALL_WAYS = ~0ull;
+
 class Cache {
 public:
     // Constants
@@ -27,6 +40,7 @@ public:
     u64 nWays;
     WritePolicy writePolicy;
     ReplacementPolicy replacementPolicy;
+    IndexFunction indexFunction;
 
     // these needs to be set on instantiation
     u64 nBlocks;
@@ -38,20 +52,63 @@ public:
     u64 lenTag;
     u64 lenIndex;
     u64 lenOffset;
+    u64 nIndexSets;     // Sets reachable by the index function
+
+    // Sectors: lines hold one valid and one dirty bit per sector, and are
+    // filled and written back a sector at a time. nSectors == 1 otherwise.
+    u64 sectorSize;
+    u64 nSectors;
+    u64 lenSector;
+    vector<u64> sectorValid;    // Per line, bit s set if sector s is present
+    vector<u64> sectorDirty;
 
     // Might be unused, depending parameters
     ReplacementManager* rm;
+    MissClassifier* classifier = nullptr;
+    HotBlockTracker* hotBlocks = nullptr;
+    SetStats* setStats = nullptr;
+    Prefetcher* prefetcher = nullptr;
+    vector<u64> prefetchCandidates;
+    WriteBuffer* writeBuffer = nullptr;
+    VictimCache* victimCache = nullptr;
+    LatencyModel* latency = nullptr;
+    WindowStats* windows = nullptr;
+    IntervalSampler* sampler = nullptr;
+    MshrModel* mshrs = nullptr;
+    // Dense block IDs of the trace, not owned: caches with the same block
+    // size share them
+    const BlockIds* blockIds = nullptr;
 
     // stats, updated as time goes
     u64 nRead = 0;
     u64 nWrite = 0;
     u64 nReadMiss = 0;
     u64 nWriteMiss = 0;
-
+    // Misses on present blocks with absent sectors. The three-C classifier
+    // works on whole blocks and leaves them to this count.
+    u64 nSectorMiss = 0;
+    u64 nValidLines = 0;
+
+    // Memory traffic in bytes, written bytes from a write buffer excluded
+    u64 nReadBytes = 0;
+    u64 nWriteBytes = 0;
+    // The part of it moved by prefetch fills, which the timing models
+    // charge as background traffic instead of to the demand access
+    u64 nPrefetchReadBytes = 0;
+    u64 nPrefetchWriteBytes = 0;
 
     unordered_map<u64, int> hashTable;
     int lastInvalidWayIndex;
     vector<u8> log;
+    bool keepLog = true;
+    bool showProgress = true;
+
+    // Ways that misses may fill, for way partitioning (see TenantSim)
+    u64 wayMask = ALL_WAYS;
+
+    // Block evicted by the latest replace(), EMPTY_KEY if an invalid line
+    // was filled. Used by the coherence directory.
+    u64 lastEvicted = EMPTY_KEY;
     
     #ifdef DEBUG
     int curInstr = 0;
@@ -63,12 +120,16 @@ public:
         u64 blockSize,
         u64 numWays,
         ReplacementPolicy replacementPolicy,
-        WritePolicy writePolicy) 
+        WritePolicy writePolicy,
+        IndexFunction indexFunction = indexBits,
+        u64 sectorSize = 0)
     :   
         blockSize(blockSize),
         nWays(numWays),
         replacementPolicy(replacementPolicy),
-        writePolicy(writePolicy)
+        writePolicy(writePolicy),
+        indexFunction(indexFunction),
+        sectorSize(sectorSize == 0 ? blockSize : sectorSize)
     {
         // assert(isPowerOfTwo(CACHE_SIZE));
         //assert(isPowerOfTwo(nWays));
@@ -84,10 +145,21 @@ public:
         assert(1ll << lenIndex == nSets);
         assert(1ll << lenOffset == blockSize);
 
-        bitsPerLine = lenTag + 1; // 1 valid bit
-        if (isWriteBack(writePolicy)) {
-            bitsPerLine++; // 1 dirty bit
+        nIndexSets = nSets;
+        if (indexFunction == indexPrime) {
+            nIndexSets = largestPrimeAtMost(nSets);
+        }
+        if (indexFunction == indexPrime || indexFunction == indexSkew) {
+            // The tag cannot be derived from the set index, lines hold
+            // the whole block address
+            lenTag = ADDR_LEN - lenOffset;
         }
+        assert(indexFunction == indexBits || nWays < nBlocks);
+        assert(indexFunction != indexSkew || replacementPolicy == LRU);
+
+        bitsPerLine = getBitsPerLine(blockSize, numWays, writePolicy, indexFunction);
+        assert(bitsPerLine == lenTag + 1 + isWriteBack(writePolicy));
+        assert(bitsPerLine <= 64);
         bytesPerLine = (bitsPerLine + 7) / 8;
         bytesPerSet = bytesPerLine * nWays;
         nBytes = bytesPerSet * nSets;
@@ -97,13 +169,30 @@ public:
             data[i] = 0u;
         }
 
+        nSectors = blockSize / this->sectorSize;
+        lenSector = log2u(this->sectorSize);
+        assert(1ll << lenSector == this->sectorSize);
+        assert(nSectors >= 1 && nSectors <= 64);
+        if (nSectors > 1) {
+            sectorValid.assign(nBlocks, 0);
+            sectorDirty.assign(nBlocks, 0);
+            // Sector bits live beside the packed lines but count as cache space
+            u64 sectorBits = nSectors * (isWriteBack(writePolicy) ? 2 : 1);
+            nBytes += (nBlocks * sectorBits + 7) / 8;
+        }
+        assert(nBytes == getNBytes(writePolicy));
+
         // Replacement data
-        if (replacementPolicy == binTree) {
+        if (indexFunction == indexSkew) {
+            rm = new RMSkewLRU(nWays, nSets);
+        } else if (replacementPolicy == binTree) {
             rm = new RMBinTree(nWays, nSets);
         } else if (replacementPolicy == LRU) {
             rm = new RMLRU(nWays, nSets);
         } else if (replacementPolicy == PLRU) {
             rm = new RMPLRU(nWays, nSets);
+        } else if (replacementPolicy == OPT) {
+            rm = new RMOPT(nWays, nSets);
         } else {
             // TODO: add another replacement policy
             printf("Not implemented\n");
@@ -133,6 +222,16 @@ public:
     ~Cache() {
         delete [] data;
         delete rm;
+        delete classifier;
+        delete hotBlocks;
+        delete setStats;
+        delete prefetcher;
+        delete writeBuffer;
+        delete victimCache;
+        delete latency;
+        delete windows;
+        delete sampler;
+        delete mshrs;
     }
 
     /*
@@ -148,13 +247,83 @@ public:
     }
 
     u64 getIndex(u64 addr) {
-        return getBits(addr, lenOffset, lenIndex);
+        if (indexFunction == indexBits) {
+            return getBits(addr, lenOffset, lenIndex);
+        }
+        return hashIndex(addr >> lenOffset, 0);
+    }
+
+    // Set of addr in the given way, which only depends on the way in
+    // skewed caches
+    u64 getIndex(u64 addr, int wayIndex) {
+        if (indexFunction == indexSkew) {
+            return hashIndex(addr >> lenOffset, wayIndex);
+        }
+        return getIndex(addr);
     }
 
     u64 getTag(u64 addr) {
+        if (indexFunction == indexPrime || indexFunction == indexSkew) {
+            return addr >> lenOffset;
+        }
         return getBits(addr, lenOffset + lenIndex, lenTag);
     }
 
+    /*
+        Index functions other than the plain bit slice:
+        - xor:   the index bits XOR all lenIndex-bit chunks of the tag
+        - prime: block address modulo the largest prime <= nSets
+        - skew:  way w XORs the index bits with the folded tag rotated by
+                 w bits, a different permutation per way (Seznec's skewed
+                 associativity)
+    */
+    u64 hashIndex(u64 block, int wayIndex) {
+        if (indexFunction == indexPrime) {
+            return block % nIndexSets;
+        }
+        u64 mask = nSets - 1;
+        u64 folded = foldTag(block >> lenIndex);
+        if (wayIndex > 0 && lenIndex > 0) {
+            int r = wayIndex % lenIndex;
+            folded = ((folded << r) | (folded >> (lenIndex - r))) & mask;
+        }
+        return (block ^ folded) & mask;
+    }
+
+    u64 foldTag(u64 tag) {
+        if (lenIndex == 0) return 0;
+        u64 folded = 0;
+        for (; tag != 0; tag >>= lenIndex) {
+            folded ^= tag;
+        }
+        return folded & (nSets - 1);
+    }
+
+    // Block address held by a line of the given set
+    u64 getBlock(u64 lineTag, u64 index) {
+        if (indexFunction == indexBits) {
+            return (lineTag << lenIndex) | index;
+        }
+        if (indexFunction == indexXor) {
+            return (lineTag << lenIndex) | (index ^ foldTag(lineTag));
+        }
+        return lineTag;
+    }
+
+    static u64 largestPrimeAtMost(u64 n) {
+        for (; n > 2; --n) {
+            bool prime = true;
+            for (u64 d = 2; d * d <= n; ++d) {
+                if (n % d == 0) {
+                    prime = false;
+                    break;
+                }
+            }
+            if (prime) return n;
+        }
+        return n;
+    }
+
     u64 getLineTag(u8* line) {
         return getBits(line, 1, lenTag); // 1 valid bit
     }
@@ -200,6 +369,7 @@ public:
 
         u64 index = getIndex(addr);
         for (u64 i = 0; i < nWays; ++i) {
+            if (indexFunction == indexSkew) index = getIndex(addr, i);
             // u8* line = set + i * bytesPerLine;
             u8* line = getLine(index, i);
             u64 lineTag = getLineTag(line);
@@ -299,14 +469,39 @@ public:
 
     // End of getters and setters
 
-    void processInstrs(vector<Instr>& instrs) {
+    /*
+        Width of a packed line: the tag (the whole block address when the
+        index function cannot give it back), a valid bit and, for
+        write-back, a dirty bit. Lines wider than 64 bits are not
+        supported, so callers can check a geometry before building it.
+    */
+    static u64 getBitsPerLine(u64 blockSize, u64 numWays, WritePolicy writePolicy,
+                              IndexFunction indexFunction) {
+        u64 nBlocks = CACHE_SIZE / blockSize;
+        u64 nSets = nBlocks / (numWays == 0 ? nBlocks : numWays);
+        u64 lenOffset = log2u(blockSize);
+        u64 lenTag = ADDR_LEN - log2u(nSets) - lenOffset;
+        if (indexFunction == indexPrime || indexFunction == indexSkew) {
+            lenTag = ADDR_LEN - lenOffset;
+        }
+        return lenTag + 1 + isWriteBack(writePolicy);
+    }
+
+    void processInstrs(const vector<Instr>& instrs) {
+        if (sampler) {
+            processSampled(instrs);
+            return;
+        }
+
         #ifdef LOG_PROGRESS
         int i = 0;
         auto t_start = std::chrono::high_resolution_clock::now();
         auto t_last_log = t_start;
         #endif
 
-        for (Instr& instr : instrs) {
+        beginTrace(instrs);
+
+        for (const Instr& instr : instrs) {
             #ifdef DEBUG
             printf("--- INSTRUCTION ID = %lld --- %u\n", i++, instr.isread);
             curInstr++;
@@ -317,13 +512,239 @@ public:
             auto t_cur = chrono::high_resolution_clock::now();
             double elapsed_time_ms = chrono::duration<double, std::milli>(t_cur - t_start).count();
             double diff_ms = chrono::duration<double, milli>(t_cur - t_last_log).count();
-            if (diff_ms > 1000) {
+            if (showProgress && diff_ms > 1000) {
                 printf("[%d/%ld] time elapsed: %.1fs\n", i, instrs.size(), elapsed_time_ms / 1000.0);
                 t_last_log = t_cur;
             }
             i++;
             #endif
         }
+
+        endTrace();
+    }
+
+    // processInstrs() is beginTrace(), processInstr() for every access and
+    // endTrace(), for callers that step through the trace themselves
+    void beginTrace(const vector<Instr>& instrs) {
+        rm->onTrace(instrs, lenOffset, blockIds);
+    }
+
+    void endTrace() {
+        if (writeBuffer) writeBuffer->flush();
+        if (windows) windows->finish();
+        if (mshrs) mshrs->finish();
+    }
+
+    /*
+        Interval sampling: only the measurement units of the sampler are
+        simulated in detail, and the log only holds their accesses. A trace
+        shorter than one period is measured whole as a single unit.
+    */
+    void processSampled(const vector<Instr>& instrs) {
+        beginTrace(instrs);
+        u64 period = sampler->period;
+        u64 nPeriods = instrs.size() / period;
+        if (nPeriods == 0) {
+            measureUnit(instrs, 0, instrs.size());
+        }
+        for (u64 p = 0; p < nPeriods; ++p) {
+            u64 unitStart = (p + 1) * period - sampler->unitLen;
+            for (u64 k = unitStart - sampler->warmLen; k < unitStart; ++k) {
+                warmInstr(instrs[k]);
+            }
+            sampler->nWarmed += sampler->warmLen;
+            measureUnit(instrs, unitStart, unitStart + sampler->unitLen);
+        }
+        endTrace();
+    }
+
+    void measureUnit(const vector<Instr>& instrs, u64 from, u64 to) {
+        if (from == to) return;
+        u64 nMiss = getMissCnt();
+        u64 nReadMissBefore = nReadMiss;
+        u64 nReadBytesBefore = nReadBytes;
+        u64 nWriteBytesBefore = nWriteBytes;
+        u64 logStart = log.size();
+        for (u64 k = from; k < to; ++k) {
+            processInstr(instrs[k]);
+        }
+        u64 counts[N_SAMPLED_METRICS] = {};
+        counts[sampleMiss] = getMissCnt() - nMiss;
+        counts[sampleReadMiss] = nReadMiss - nReadMissBefore;
+        counts[sampleReadBytes] = nReadBytes - nReadBytesBefore;
+        counts[sampleWriteBytes] = nWriteBytes - nWriteBytesBefore;
+        for (u64 k = logStart; k < log.size(); ++k) {
+            counts[sampleWriteMem] += (log[k] & LOG_WRITE_MEM) != 0;
+            counts[sampleReadMem] += (log[k] & LOG_REPLACE) != 0;
+        }
+        sampler->addUnit(counts, to - from);
+    }
+
+    /*
+        Warm-up: the first accesses only warm the cache functionally, up
+        to maxLen of them, and with untilFull no further than the access
+        that makes every usable line valid. Statistics and the log then
+        start from zero. prepare, if given, is applied to each access just
+        before it is used (address translation), so it sees exactly the
+        warm-up accesses. Returns the number of accesses used.
+    */
+    u64 warmUp(vector<Instr>& instrs, u64 maxLen, bool untilFull,
+               const function<void(Instr&)>& prepare = nullptr) {
+        u64 k = 0;
+        for (; k < maxLen && k < instrs.size(); ++k) {
+            if (untilFull && nValidLines == nIndexSets * nWays) break;
+            if (prepare) prepare(instrs[k]);
+            warmInstr(instrs[k]);
+        }
+        resetStats();
+        return k;
+    }
+
+    void resetStats() {
+        nRead = nWrite = 0;
+        nReadMiss = nWriteMiss = nSectorMiss = 0;
+        nReadBytes = nWriteBytes = 0;
+        nPrefetchReadBytes = nPrefetchWriteBytes = 0;
+        log.clear();
+    }
+
+    // Functional warming: the tag, dirty bit and replacement updates of an
+    // access, with no statistics, observers or log
+    void warmInstr(const Instr& instr) {
+        u64 addr = instr.addr;
+        u64 index = getIndex(addr);
+        bool markWrite = !instr.isread && isWriteBack(writePolicy);
+        int wayIndex = findLine(addr);
+        if (wayIndex != -1) {
+            if (indexFunction == indexSkew) index = getIndex(addr, wayIndex);
+            rm->onAccess(index, wayIndex);
+            if (markWrite) setDirty(index, wayIndex, true);
+            return;
+        }
+        if (!instr.isread && !isWriteAlloc(writePolicy)) return;
+        // Same way choice as read() and write()
+        int replaceWayIndex = getReplacement(addr, index);
+        if (replaceWayIndex == -1 && !instr.isread) {
+            replaceWayIndex = findInvalidLine(index);
+        }
+        u8 accessInfo = 0;
+        int filledWayIndex = replace(index, replaceWayIndex, addr, accessInfo);
+        rm->onAccess(index, replaceWayIndex);
+        if (markWrite) setDirty(index, filledWayIndex, true);
+    }
+
+    /*
+        Hit runs: consecutive accesses to the same block. Once the first
+        access of a run has the block in the cache, the others are hits
+        that repeat its replacement update, so a run is applied at once.
+        Only valid without features that act on every access (prefetcher,
+        write buffer, sectors, OPT).
+    */
+
+    // Lengths of the runs of instrs, for blocks of 2^lenOffset bytes
+    static vector<u32> encodeRuns(const vector<Instr>& instrs, u64 lenOffset) {
+        vector<u32> runs;
+        for (u64 k = 0; k < instrs.size(); ++k) {
+            bool sameBlock = k > 0 && (instrs[k].addr >> lenOffset) == (instrs[k - 1].addr >> lenOffset);
+            if (sameBlock && runs.back() < ~0u) {
+                runs.back()++;
+            } else {
+                runs.push_back(1);
+            }
+        }
+        return runs;
+    }
+
+    void processRuns(const vector<Instr>& instrs, const vector<u32>& runs) {
+        beginTrace(instrs);
+        u64 k = 0;
+        for (u32 len : runs) {
+            processRun(instrs, k, k + len);
+            k += len;
+        }
+        endTrace();
+    }
+
+    void processRun(const vector<Instr>& instrs, u64 k, u64 end) {
+        // A write miss without allocation leaves the block out, and the
+        // next access of the run is simulated in full too
+        while (k < end) {
+            const Instr& instr = instrs[k++];
+            u8 accessInfo = processInstr(instr);
+            if (instr.isread || isWriteAlloc(writePolicy) || (accessInfo & LOG_HIT)) break;
+        }
+        if (k < end) repeatHits(instrs, k, end);
+    }
+
+    // Accesses [k, end) all hit the block the access before them left
+    void repeatHits(const vector<Instr>& instrs, u64 k, u64 end) {
+        u64 addr = instrs[k].addr;
+        int wayIndex = findLine(addr);
+        assert(wayIndex != -1);
+        u64 index = indexFunction == indexSkew ? getIndex(addr, wayIndex) : getIndex(addr);
+        u64 tag = getTag(addr);
+
+        // The access before may have updated another way (a read miss
+        // hands binTree the unresolved way), so one full update first
+        rm->onAccess(index, wayIndex);
+        rm->onRepeat(index, wayIndex, end - k - 1);
+
+        bool written = false;
+        if (!classifier && !setStats && !latency && !mshrs && !windows && !writeBuffer) {
+            written = countHits(instrs, k, end);
+            k = end;
+        }
+        for (; k < end; ++k) {
+            const Instr& instr = instrs[k];
+            u8 accessInfo = LOG_HIT;
+            u64 writeMark = getDemandWriteBytes();
+            if (classifier) {
+                classifier->onAccess(instr.addr, false, instr.isread || isWriteAlloc(writePolicy));
+            }
+            if (setStats) setStats->onAccess(index, tag, false);
+            if (instr.isread) {
+                nRead++;
+            } else {
+                nWrite++;
+                written = true;
+                if (isWriteThrough(writePolicy)) writeMem(instr.addr, accessInfo);
+            }
+            timeAccess(instr.addr, accessInfo, getDemandReadBytes(), writeMark);
+            if (windows) windows->onAccess(instr.isread, accessInfo);
+            if (keepLog) log.push_back(accessInfo);
+        }
+        if (written && isWriteBack(writePolicy)) {
+            markDirty(index, wayIndex, addr);
+        }
+    }
+
+    // repeatHits() with nothing observing single accesses: the counters
+    // move by the run's totals and the log grows in one piece, with
+    // write-through writes still marked as memory writes. Returns whether
+    // the run wrote.
+    bool countHits(const vector<Instr>& instrs, u64 k, u64 end) {
+        u64 n = end - k;
+        u64 nWrites = 0;
+        if (keepLog && isWriteThrough(writePolicy)) {
+            u64 at = log.size();
+            log.resize(at + n, LOG_HIT);
+            for (u64 i = 0; i < n; ++i) {
+                bool isWrite = !instrs[k + i].isread;
+                nWrites += isWrite;
+                log[at + i] |= isWrite ? LOG_WRITE_MEM : 0;
+            }
+        } else {
+            for (u64 i = k; i < end; ++i) {
+                nWrites += !instrs[i].isread;
+            }
+            if (keepLog) log.resize(log.size() + n, LOG_HIT);
+        }
+        nRead += n - nWrites;
+        nWrite += nWrites;
+        if (isWriteThrough(writePolicy)) {
+            nWriteBytes += nWrites * (WORD_SIZE < blockSize ? WORD_SIZE : blockSize);
+        }
+        return nWrites > 0;
     }
 
     void printSet(int index) {
@@ -334,14 +755,45 @@ public:
         printf("%d, %u %llx %u\n", index, dirty, tag, valid);
     }
 
-    void processInstr(Instr& instr) {
+    u8 processInstr(const Instr& instr) {
         u8 accessInfo = 0;
+        u64 readMark = getDemandReadBytes();
+        u64 writeMark = getDemandWriteBytes();
+        u64 prefetchMark = nPrefetchReadBytes + nPrefetchWriteBytes;
+        u64 drainMark = writeBuffer ? writeBuffer->nIssuedBytes : 0;
+        rm->onInstr(getAccessCnt());
+        if (writeBuffer) writeBuffer->tick(getAccessCnt());
         if (instr.isread) {
             read(instr.addr, accessInfo);
         } else {
             write(instr.addr, 0, accessInfo);
         }
-        log.push_back(accessInfo);
+        // Buffered writes drained during the access keep the bus busy
+        if (latency && writeBuffer) latency->onBackground(writeBuffer->nIssuedBytes - drainMark);
+        timeAccess(instr.addr, accessInfo, readMark, writeMark);
+        // Prefetches the access triggered follow it on the bus
+        if (latency) latency->onBackground(nPrefetchReadBytes + nPrefetchWriteBytes - prefetchMark);
+        if (windows) windows->onAccess(instr.isread, accessInfo);
+        if (keepLog) log.push_back(accessInfo);
+        return accessInfo;
+    }
+
+    // Bytes moved for demand accesses, prefetch fills excluded
+    u64 getDemandReadBytes() {
+        return nReadBytes - nPrefetchReadBytes;
+    }
+
+    u64 getDemandWriteBytes() {
+        return nWriteBytes - nPrefetchWriteBytes;
+    }
+
+    // Feeds the timing models with the bytes the access moved, which is
+    // how much the demand byte counts grew past the marks taken before it
+    void timeAccess(u64 addr, u8 accessInfo, u64 readMark, u64 writeMark) {
+        u64 readBytes = getDemandReadBytes() - readMark;
+        u64 writeBytes = getDemandWriteBytes() - writeMark;
+        if (latency) latency->onAccess(accessInfo, readBytes, writeBytes);
+        if (mshrs) mshrs->onAccess(addr >> lenOffset, accessInfo, readBytes, writeBytes);
     }
 
     void read(u64 addr, u8& accessInfo) {
@@ -355,28 +807,52 @@ public:
         #endif
 
         int wayIndex = findLine(addr);
+        if (wayIndex != -1 && indexFunction == indexSkew) {
+            index = getIndex(addr, wayIndex);
+        }
+        bool sectorMiss = wayIndex != -1 && !hasSector(index, wayIndex, addr);
+        if (classifier) classifier->onAccess(addr, wayIndex == -1, true);
+        if (setStats) setStats->onAccess(index, tag, wayIndex == -1 || sectorMiss);
         
         accessInfo = 0;
-        if (wayIndex != -1) {
+        if (wayIndex != -1 && !sectorMiss) {
             // Hit
             #ifdef DEBUG
             printf("read hit\n");
             #endif
             accessInfo |= LOG_HIT;
             rm->onAccess(index, wayIndex);
+        } else if (wayIndex != -1) {
+            // The block is present but the sector is not
+            if (hotBlocks) hotBlocks->onMiss(addr >> lenOffset);
+            fillSector(index, wayIndex, addr, accessInfo);
+            rm->onAccess(index, wayIndex);
+            nReadMiss++;
+            nSectorMiss++;
         } else {
             // Miss
-            accessInfo |= LOG_REPLACE;
-            int replaceWayIndex = rm->getReplacement(index);
+            if (hotBlocks) hotBlocks->onMiss(addr >> lenOffset);
+            if (prefetcher) prefetcher->onDemandMiss(addr >> lenOffset);
+            // A victim cache hit swaps the line back without reading memory
+            bool victimDirty = false;
+            bool victimHit = victimCache && victimCache->take(addr >> lenOffset, victimDirty);
+            if (!victimHit) {
+                readMem(addr, accessInfo);
+            }
+            int replaceWayIndex = getReplacement(addr, index);
             #ifdef DEBUG
             idxCnt[replaceWayIndex]++;
             #endif
-            replace(index, replaceWayIndex, addr, accessInfo);
+            int filledWayIndex = replace(index, replaceWayIndex, addr, accessInfo);
             rm->onAccess(index, replaceWayIndex);
+            if (victimDirty) {
+                setDirty(index, filledWayIndex, true);
+            }
 
             nReadMiss++;
         }
         nRead++;
+        if (prefetcher) prefetchAfter(addr, index, wayIndex);
     }
 
     void write(u64 addr, u8 byte, u8& accessInfo) {
@@ -390,9 +866,32 @@ public:
         #endif
 
         int wayIndex = findLine(addr);
+        if (wayIndex != -1 && indexFunction == indexSkew) {
+            index = getIndex(addr, wayIndex);
+        }
+        bool sectorMiss = wayIndex != -1 && !hasSector(index, wayIndex, addr);
+        if (classifier) classifier->onAccess(addr, wayIndex == -1, isWriteAlloc(writePolicy));
+        if (setStats) setStats->onAccess(index, tag, wayIndex == -1 || sectorMiss);
 
         accessInfo = 0;
-        if (wayIndex != -1) {
+        if (sectorMiss) {
+            // The block is present but the sector is not. Without write
+            // allocation the write bypasses the line.
+            if (hotBlocks) hotBlocks->onMiss(addr >> lenOffset);
+            if (isWriteAlloc(writePolicy)) {
+                fillSector(index, wayIndex, addr, accessInfo);
+                rm->onAccess(index, wayIndex);
+                if (isWriteBack(writePolicy)) {
+                    markDirty(index, wayIndex, addr);
+                } else {
+                    writeMem(addr, accessInfo);
+                }
+            } else {
+                writeMem(addr, accessInfo);
+            }
+            nWriteMiss++;
+            nSectorMiss++;
+        } else if (wayIndex != -1) {
             // Hit
             #ifdef DEBUG
             printf("write hit\n");
@@ -404,14 +903,18 @@ public:
                 #ifdef DEBUG
                 printf("write hit, goto setDirty\n");
                 #endif
-                setDirty(index, wayIndex, true);
+                markDirty(index, wayIndex, addr);
             } else {
-                accessInfo |= LOG_WRITE_MEM;
+                writeMem(addr, accessInfo);
             }
         } else {
             // Miss
+            if (hotBlocks) hotBlocks->onMiss(addr >> lenOffset);
+            if (prefetcher) prefetcher->onDemandMiss(addr >> lenOffset);
             if (isWriteAlloc(writePolicy)) {
-                u64 replaceWayIndex = rm->getReplacement(index);
+                bool victimDirty = false;
+                bool victimHit = victimCache && victimCache->take(addr >> lenOffset, victimDirty);
+                u64 replaceWayIndex = getReplacement(addr, index);
                 #ifdef DEBUG
                 idxCnt[replaceWayIndex]++;
                 #endif
@@ -421,24 +924,140 @@ public:
                 replace(index, replaceWayIndex, addr, accessInfo);
                 rm->onAccess(index, replaceWayIndex);
 
-                accessInfo |= LOG_REPLACE;
+                if (!victimHit) {
+                    readMem(addr, accessInfo);
+                }
                 if (isWriteThrough(writePolicy)) {
                     // Write to memory after replacing on Write-through
-                    accessInfo |= LOG_WRITE_MEM;
+                    writeMem(addr, accessInfo);
                 } else {
                     // Writing to new block makes it dirty
-                    setDirty(index, replaceWayIndex, true);
+                    markDirty(index, replaceWayIndex, addr);
                 }
             } else {
-                accessInfo |= LOG_WRITE_MEM;
+                // Write-back lines held by the victim cache absorb the write
+                bool absorbed = victimCache
+                    && victimCache->write(addr >> lenOffset, isWriteBack(writePolicy))
+                    && isWriteBack(writePolicy);
+                if (!absorbed) {
+                    writeMem(addr, accessInfo);
+                }
             }
 
             nWriteMiss++;
         }
         nWrite++;
+        if (prefetcher) prefetchAfter(addr, index, wayIndex);
     }
 
-    void replace(u64 index, int wayIndex, u64 addr, u8& accessInfo) {
+    // Way to fill for addr, -1 meaning the first invalid line of the set.
+    // In skewed caches every way has its own set, so this also moves index
+    // to the set of the chosen way: the first invalid candidate, else the
+    // least recently used one.
+    int getReplacement(u64 addr, u64& index) {
+        if (wayMask != ALL_WAYS) {
+            // Partitioned: an invalid line of the partition first, else
+            // the policy's choice within it
+            for (u64 i = 0; i < nWays; ++i) {
+                if ((wayMask >> i & 1) && !isValid(index, i)) return i;
+            }
+            return rm->getMaskedReplacement(index, wayMask);
+        }
+        if (indexFunction != indexSkew) {
+            return rm->getReplacement(index);
+        }
+        RMSkewLRU* skewRm = (RMSkewLRU*) rm;
+        int best = 0;
+        u32 bestStamp = ~0u;
+        for (u64 i = 0; i < nWays; ++i) {
+            u64 candidate = getIndex(addr, i);
+            if (!isValid(candidate, i)) {
+                best = i;
+                break;
+            }
+            u32 stamp = skewRm->getStamp(candidate, i);
+            if (stamp < bestStamp) {
+                best = i;
+                bestStamp = stamp;
+            }
+        }
+        index = getIndex(addr, best);
+        return best;
+    }
+
+    // Writes that go straight to memory are queued in the write buffer
+    // when there is one, and only counted once the buffer issues them.
+    void writeMem(u64 addr, u8& accessInfo) {
+        if (writeBuffer) {
+            writeBuffer->write(addr >> lenOffset, getWordIndex(addr), getAccessCnt());
+        } else {
+            accessInfo |= LOG_WRITE_MEM;
+            nWriteBytes += WORD_SIZE < blockSize ? WORD_SIZE : blockSize;
+        }
+    }
+
+    // Reads the sector holding addr. Words still in the write buffer are
+    // forwarded from it, and a sector it holds entirely needs no memory
+    // read at all.
+    void readMem(u64 addr, u8& accessInfo) {
+        u64 bytes = sectorSize;
+        if (writeBuffer) {
+            u64 begin = getOffset(addr) >> lenSector << lenSector;
+            bytes -= writeBuffer->read(addr >> lenOffset, begin, sectorSize);
+        }
+        if (bytes == 0) return;
+        accessInfo |= LOG_REPLACE;
+        nReadBytes += bytes;
+    }
+
+    // Tag and state storage of this cache under a write policy. Only
+    // write-back lines carry dirty bits.
+    u64 getNBytes(WritePolicy policy) {
+        u64 bits = lenTag + 1 + isWriteBack(policy);
+        u64 bytes = (bits + 7) / 8 * nBlocks;
+        if (nSectors > 1) {
+            bytes += (nBlocks * nSectors * (isWriteBack(policy) ? 2 : 1) + 7) / 8;
+        }
+        return bytes;
+    }
+
+    /*
+        Sectors
+    */
+
+    u64 getWordIndex(u64 addr) {
+        return WORD_SIZE < blockSize ? getOffset(addr) / WORD_SIZE : 0;
+    }
+
+    u64 getSectorBit(u64 addr) {
+        return 1ull << (getOffset(addr) >> lenSector);
+    }
+
+    bool hasSector(u64 index, int wayIndex, u64 addr) {
+        return nSectors == 1 || (sectorValid[index * nWays + wayIndex] & getSectorBit(addr));
+    }
+
+    // Reads the sector holding addr into a line whose block is present
+    void fillSector(u64 index, int wayIndex, u64 addr, u8& accessInfo) {
+        sectorValid[index * nWays + wayIndex] |= getSectorBit(addr);
+        readMem(addr, accessInfo);
+    }
+
+    void markDirty(u64 index, int wayIndex, u64 addr) {
+        setDirty(index, wayIndex, true);
+        if (nSectors > 1) {
+            sectorDirty[index * nWays + wayIndex] |= getSectorBit(addr);
+        }
+    }
+
+    // Bytes written back when the dirty line is evicted
+    u64 getDirtyBytes(u64 index, int wayIndex) {
+        if (nSectors == 1) return blockSize;
+        return __builtin_popcountll(sectorDirty[index * nWays + wayIndex]) * sectorSize;
+    }
+
+    // Returns the way index that was filled
+    int replace(u64 index, int wayIndex, u64 addr, u8& accessInfo) {
         #ifdef DEBUG
         printf("replace\n");
         #endif
@@ -457,17 +1076,41 @@ public:
         u64 tag = getTag(addr);
         u64 oldTag = getLineTag(line);
 
-        if (isWriteBack(writePolicy) && isValid(line) && isDirty(line)) {
+        if (prefetcher) prefetcher->onFill(index * nWays + wayIndex, false, getAccessCnt());
+
+        lastEvicted = replacingInvalid ? EMPTY_KEY : getBlock(oldTag, index);
+
+        bool dirtyEvict = isWriteBack(writePolicy) && isValid(line) && isDirty(line);
+        if (setStats) setStats->onReplace(index, !replacingInvalid, dirtyEvict);
+        if (victimCache) {
+            // Evicted lines go to the victim cache, which defers their
+            // writeback until it drops them
+            if (!replacingInvalid) {
+                u64 written = victimCache->insert(getBlock(oldTag, index), dirtyEvict);
+                if (written != EMPTY_KEY) {
+                    accessInfo |= LOG_WRITE_MEM;
+                    nWriteBytes += blockSize;
+                    if (hotBlocks) hotBlocks->onWriteback(written);
+                }
+            }
+        } else if (dirtyEvict) {
             // Write dirty block to memory
             accessInfo |= LOG_WRITE_MEM;
+            nWriteBytes += getDirtyBytes(index, wayIndex);
+            if (hotBlocks) hotBlocks->onWriteback(getBlock(oldTag, index));
         }
         // printSet(2539);
         setTag(line, tag);
         // printSet(2539);
         setValid(line, true);
+        nValidLines += replacingInvalid;
         if (isWriteBack(writePolicy)) {
             setDirty(index, wayIndex, false);
         }
+        if (nSectors > 1) {
+            sectorValid[index * nWays + wayIndex] = getSectorBit(addr);
+            sectorDirty[index * nWays + wayIndex] = 0;
+        }
 
         if (replacingInvalid && wayIndex == nWays - 1) {
             // Because cache will not be invalid after becoming valid,
@@ -478,7 +1121,7 @@ public:
 
         if (nWays == nBlocks) {
             auto it = hashTable.find(oldTag);
-            if (it != hashTable.end()) {
+            if (!replacingInvalid && it != hashTable.end()) {
                 // cout << "ERASE\n";
                 hashTable.erase(oldTag);
             }
@@ -488,6 +1131,98 @@ public:
             }
             assert(hashTable.size() <= nWays);
         }
+        return wayIndex;
+    }
+
+    /*
+        Coherence
+    */
+
+    // Drops the line holding addr, if any. Returns whether it was dirty.
+    // Replacement state is left untouched, so the way is simply refilled
+    // once the policy picks it again.
+    bool invalidate(u64 addr) {
+        int wayIndex = findLine(addr);
+        if (wayIndex == -1) return false;
+        u64 index = getIndex(addr, wayIndex);
+        u8* line = at(index, wayIndex);
+        bool dirty = isWriteBack(writePolicy) && isDirty(line);
+        setValid(line, false);
+        nValidLines--;
+        if (isWriteBack(writePolicy)) {
+            setDirty(index, wayIndex, false);
+        }
+        if (nWays == nBlocks) {
+            hashTable.erase(getTag(addr));
+        }
+        return dirty;
+    }
+
+    // Clears the dirty bit of the line holding addr (its data was written
+    // back). Returns whether it was dirty.
+    bool clean(u64 addr) {
+        int wayIndex = findLine(addr);
+        if (wayIndex == -1 || isWriteThrough(writePolicy)) return false;
+        u64 index = getIndex(addr, wayIndex);
+        bool dirty = isDirty(at(index, wayIndex));
+        setDirty(index, wayIndex, false);
+        return dirty;
+    }
+
+    /*
+        Prefetching
+    */
+
+    // Trains the prefetcher with a demand access (wayIndex is the hit way,
+    // or -1 on a miss) and issues the fills it proposes.
+    void prefetchAfter(u64 addr, u64 index, int wayIndex) {
+        bool trigger = (wayIndex == -1);
+        if (wayIndex != -1) {
+            u64 lineIdx = index * nWays + wayIndex;
+            trigger = prefetcher->isPrefetched[lineIdx];
+            prefetcher->onDemandHit(lineIdx, getAccessCnt());
+        }
+        prefetchCandidates.clear();
+        prefetcher->onAccess(addr >> lenOffset, trigger, prefetchCandidates);
+        for (u64 block : prefetchCandidates) {
+            prefetchFill(block);
+        }
+    }
+
+    void prefetchFill(u64 block) {
+        if (block > (~0ull >> lenOffset)) return;  // Wrapped around
+        u64 addr = block << lenOffset;
+        if (findLine(addr) != -1) return;
+
+        u64 index = getIndex(addr);
+        int wayIndex = getReplacement(addr, index);
+        if (wayIndex == -1) {
+            wayIndex = findInvalidLine(index);
+        }
+        u8* line = at(index, wayIndex);
+        if (isValid(line)) {
+            prefetcher->onPrefetchEvict(getBlock(getLineTag(line), index));
+        }
+
+        // A block in the victim cache moves back with its dirty bit, so
+        // the two never hold it at once, and memory is not read
+        bool victimDirty = false;
+        bool fromVictim = victimCache && victimCache->remove(block, victimDirty);
+
+        u8 info = 0;
+        u64 readMark = nReadBytes;
+        u64 writeMark = nWriteBytes;
+        int filledWayIndex = replace(index, wayIndex, addr, info);
+        if (!fromVictim) nReadBytes += blockSize;
+        if (victimDirty) setDirty(index, filledWayIndex, true);
+        rm->onAccess(index, wayIndex);
+        if (info & LOG_WRITE_MEM) {
+            prefetcher->nWriteback++;
+        }
+        nPrefetchReadBytes += nReadBytes - readMark;
+        nPrefetchWriteBytes += nWriteBytes - writeMark;
+        prefetcher->isPrefetched[index * nWays + wayIndex] = 1;
+        prefetcher->nIssued++;
     }
 
     /*
@@ -519,9 +1254,14 @@ public:
                 cnt++;
             }
         }
+        if (writeBuffer) cnt += writeBuffer->nIssued;
         return cnt;
     }
 
+    u64 getWriteMemBytes() {
+        return nWriteBytes + (writeBuffer ? writeBuffer->nIssuedBytes : 0);
+    }
+
     u64 getReadMemCnt() {
         u64 cnt = 0;
         for (u8 info : log) {
@@ -537,6 +1277,10 @@ public:
     */
 
     void outputLog(string filename) {
+        writeLog(filename, log);
+    }
+
+    static void writeLog(string filename, const vector<u8>& log) {
         ofstream fout(filename);
         if (fout.is_open()) {
             for (u8 info : log) {
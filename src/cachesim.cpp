@@ -0,0 +1,129 @@
+/*
+    C ABI wrapper around Cache, built as libcachesim.so. See cachesim.h.
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <unordered_map>
+
+#include "global.hpp"
+#include "cache.hpp"
+#include "utils.hpp"
+#include "cachesim.h"
+
+using namespace std;
+
+struct cachesim {
+    Cache* cache;
+    u64 nWriteMem;
+    u64 nReadMem;
+};
+
+// Everything the Cache constructor and replacement managers would assert
+static bool isValidGeometry(u64 blockSize, u64 nWays, ReplacementPolicy rp, WritePolicy wp) {
+    if (blockSize == 0 || !isPowerOfTwo(blockSize) || blockSize > CACHE_SIZE) return false;
+    u64 nBlocks = CACHE_SIZE / blockSize;
+    if (nWays > nBlocks) return false;
+    if (nWays != 0) {
+        u64 nSets = nBlocks / nWays;
+        if (nBlocks % nWays != 0 || !isPowerOfTwo(nSets)) return false;
+    }
+    // PLRU is implemented for 8 ways only
+    if (rp == PLRU && (nWays == 0 ? nBlocks : nWays) != 8) return false;
+    return Cache::getBitsPerLine(blockSize, nWays, wp, indexBits) <= 64;
+}
+
+extern "C" {
+
+int cachesim_abi_version(void) {
+    return CACHESIM_ABI_VERSION;
+}
+
+cachesim_t* cachesim_create(uint64_t block_size, uint64_t n_ways,
+                            const char* replacement, const char* write_policy) {
+    if (replacement == nullptr || write_policy == nullptr) return nullptr;
+    ReplacementPolicy rp = sToReplace(replacement);
+    WritePolicy wp = sToWrite(write_policy);
+    if (rp == replaceNull || rp == OPT || wp == writeNull) return nullptr;
+    if (!isValidGeometry(block_size, n_ways, rp, wp)) return nullptr;
+
+    cachesim_t* sim = new cachesim_t;
+    sim->cache = new Cache(block_size, n_ways, rp, wp);
+    sim->nWriteMem = 0;
+    sim->nReadMem = 0;
+    return sim;
+}
+
+void cachesim_destroy(cachesim_t* sim) {
+    if (sim == nullptr) return;
+    delete sim->cache;
+    delete sim;
+}
+
+int cachesim_access_batch(cachesim_t* sim, const uint64_t* addrs,
+                          const uint8_t* is_read, uint64_t n, uint8_t* flags_out) {
+    if (sim == nullptr || (n > 0 && (addrs == nullptr || is_read == nullptr))) {
+        return CACHESIM_EINVAL;
+    }
+    Cache& cache = *sim->cache;
+    for (uint64_t i = 0; i < n; ++i) {
+        Instr instr(is_read[i] != 0, addrs[i]);
+        u8 info = cache.processInstr(instr);
+        sim->nWriteMem += (info & LOG_WRITE_MEM) != 0;
+        sim->nReadMem += (info & LOG_REPLACE) != 0;
+        if (flags_out != nullptr) flags_out[i] = info;
+    }
+    return 0;
+}
+
+int cachesim_get_counters(const cachesim_t* sim, uint64_t* out, uint64_t n) {
+    if (sim == nullptr || (n > 0 && out == nullptr)) return CACHESIM_EINVAL;
+    Cache& cache = *sim->cache;
+    uint64_t counters[CACHESIM_N_COUNTERS] = {
+        cache.getAccessCnt(),
+        cache.nRead,
+        cache.nWrite,
+        cache.nReadMiss,
+        cache.nWriteMiss,
+        sim->nWriteMem,
+        sim->nReadMem,
+        cache.nBytes,
+        (uint64_t) cache.rm->getNBytes(),
+        cache.nReadBytes,
+        cache.getWriteMemBytes()
+    };
+    if (n > CACHESIM_N_COUNTERS) n = CACHESIM_N_COUNTERS;
+    memcpy(out, counters, n * sizeof(uint64_t));
+    return 0;
+}
+
+int cachesim_set_keep_log(cachesim_t* sim, int keep) {
+    if (sim == nullptr) return CACHESIM_EINVAL;
+    sim->cache->keepLog = keep != 0;
+    return 0;
+}
+
+uint64_t cachesim_log_size(const cachesim_t* sim) {
+    return sim == nullptr ? 0 : sim->cache->log.size();
+}
+
+uint64_t cachesim_read_log(const cachesim_t* sim, uint64_t offset, uint8_t* out, uint64_t n) {
+    if (sim == nullptr || out == nullptr) return 0;
+    const vector<u8>& log = sim->cache->log;
+    if (offset >= log.size()) return 0;
+    if (n > log.size() - offset) n = log.size() - offset;
+    memcpy(out, log.data() + offset, n);
+    return n;
+}
+
+const uint8_t* cachesim_log_data(const cachesim_t* sim) {
+    return sim == nullptr ? nullptr : sim->cache->log.data();
+}
+
+void cachesim_clear_log(cachesim_t* sim) {
+    if (sim == nullptr) return;
+    sim->cache->log.clear();
+}
+
+}
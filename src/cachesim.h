@@ -0,0 +1,92 @@
+/*
+    C ABI of the cache simulator core, built as libcachesim.so
+    (`make lib`). Lets callers such as Python (ctypes + NumPy) drive a
+    Cache directly from their own buffers, without text I/O or spawning
+    ./main per configuration.
+
+    All functions returning int return 0 on success and a negative
+    CACHESIM_E* code on failure.
+*/
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CACHESIM_ABI_VERSION 1
+
+/* Only the functions below are exported; build with -fvisibility=hidden */
+#if defined(__GNUC__)
+#define CACHESIM_API __attribute__((visibility("default")))
+#else
+#define CACHESIM_API
+#endif
+
+#define CACHESIM_EINVAL (-1)
+#define CACHESIM_ERANGE (-2)
+
+/* Bits of the per-access flag log, same as LOG_* in global.hpp */
+#define CACHESIM_LOG_HIT        0x01
+#define CACHESIM_LOG_READ_MEM   0x02
+#define CACHESIM_LOG_WRITE_MEM  0x04
+#define CACHESIM_LOG_REPLACE    0x08
+
+/* Indices into the counter array filled by cachesim_get_counters() */
+enum cachesim_counter {
+    CACHESIM_ACCESS = 0,
+    CACHESIM_READ,
+    CACHESIM_WRITE,
+    CACHESIM_READ_MISS,
+    CACHESIM_WRITE_MISS,
+    CACHESIM_WRITE_MEM,
+    CACHESIM_READ_MEM,
+    CACHESIM_CACHE_BYTES,
+    CACHESIM_REPLACE_BYTES,
+    CACHESIM_READ_MEM_BYTES,
+    CACHESIM_WRITE_MEM_BYTES,
+    CACHESIM_N_COUNTERS
+};
+
+typedef struct cachesim cachesim_t;
+
+CACHESIM_API int cachesim_abi_version(void);
+
+/*
+    Creates a cache. block_size and n_ways follow ./main (n_ways == 0 is
+    fully-associative); policies use the same names, e.g. "LRU" and
+    "back_alloc". OPT is not available since it needs the whole trace up
+    front. Returns NULL on invalid parameters.
+*/
+CACHESIM_API cachesim_t* cachesim_create(uint64_t block_size, uint64_t n_ways,
+                                         const char* replacement, const char* write_policy);
+CACHESIM_API void cachesim_destroy(cachesim_t* sim);
+
+/*
+    Simulates n accesses read from caller-owned arrays: addrs[i] with
+    is_read[i] != 0 for reads. If flags_out is not NULL, the per-access
+    flag byte is written to flags_out[i]. Flags are also appended to the
+    internal log unless it was turned off with cachesim_set_keep_log().
+*/
+CACHESIM_API int cachesim_access_batch(cachesim_t* sim, const uint64_t* addrs,
+                                       const uint8_t* is_read, uint64_t n, uint8_t* flags_out);
+
+/* Copies min(n, CACHESIM_N_COUNTERS) counters into out */
+CACHESIM_API int cachesim_get_counters(const cachesim_t* sim, uint64_t* out, uint64_t n);
+
+/* Internal flag log, kept by default so results match ./main's logs */
+CACHESIM_API int cachesim_set_keep_log(cachesim_t* sim, int keep);
+CACHESIM_API uint64_t cachesim_log_size(const cachesim_t* sim);
+/* Copies up to n flags starting at offset, returns the number copied */
+CACHESIM_API uint64_t cachesim_read_log(const cachesim_t* sim, uint64_t offset, uint8_t* out, uint64_t n);
+/* Zero-copy view of the log, valid until the next batch or clear */
+CACHESIM_API const uint8_t* cachesim_log_data(const cachesim_t* sim);
+CACHESIM_API void cachesim_clear_log(cachesim_t* sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
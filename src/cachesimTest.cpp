@@ -0,0 +1,48 @@
+/*
+    Checks of the C ABI in libcachesim.so (`make test`): parameters the
+    core cannot handle must give NULL, not abort the caller.
+*/
+#include <cstdio>
+#include <cstdint>
+
+#include "cachesim.h"
+
+static int nFailed = 0;
+
+static void expectCreate(uint64_t blockSize, uint64_t nWays, const char* replacement,
+                         const char* writePolicy, bool valid) {
+    cachesim_t* sim = cachesim_create(blockSize, nWays, replacement, writePolicy);
+    if ((sim != nullptr) != valid) {
+        printf("FAIL: cachesim_create(%llu, %llu, %s, %s) %s\n", (unsigned long long) blockSize,
+               (unsigned long long) nWays, replacement, writePolicy,
+               valid ? "returned NULL" : "accepted invalid parameters");
+        nFailed++;
+    }
+    if (sim != nullptr) {
+        uint64_t addrs[2] = { 0x1000, 0x2000 };
+        uint8_t isRead[2] = { 1, 0 };
+        cachesim_access_batch(sim, addrs, isRead, 2, nullptr);
+        cachesim_destroy(sim);
+    }
+}
+
+int main() {
+    // PLRU only exists for 8 ways
+    expectCreate(8, 8, "PLRU", "back_alloc", true);
+    expectCreate(8, 4, "PLRU", "back_alloc", false);
+    expectCreate(8, 0, "PLRU", "back_alloc", false);
+
+    // Fully associative 1-byte blocks need a tag wider than a packed line
+    expectCreate(1, 0, "LRU", "back_alloc", false);
+    expectCreate(1, 0, "LRU", "through_alloc", false);
+    expectCreate(1, 1, "LRU", "back_alloc", true);
+    expectCreate(8, 0, "LRU", "back_alloc", true);
+
+    expectCreate(3, 4, "LRU", "back_alloc", false);
+    expectCreate(8, 3, "LRU", "back_alloc", false);
+    expectCreate(8, 8, "OPT", "back_alloc", false);
+    expectCreate(8, 8, "LRU", "back", false);
+
+    if (nFailed == 0) printf("cachesim tests OK\n");
+    return nFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+#include "instr.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+/*
+    Multi-core simulation: one private write-back Cache per core, kept
+    coherent with MESI through a directory, replayed in the deterministic
+    global order of a tagged trace.
+
+    A directory entry records which cores hold a block and whether the
+    single holder has it exclusively (E, or M when its line is dirty);
+    otherwise all holders are in S. Lines not in the directory are I.
+
+    For speed the trace is processed in epochs. In each epoch, worker
+    threads first run every core's accesses in parallel for as long as they
+    are private hits: hits (writes only with exclusive ownership) to blocks
+    no other core touches during the epoch. Such accesses commute with
+    every other core's accesses, so running them early gives the same
+    result as the serial order. The rest of the epoch is then replayed
+    serially in global order with the coherence protocol.
+*/
+struct DirEntry {
+    u64 sharers = 0;        // Bit c set if core c holds the block
+    bool exclusive = false;
+};
+
+struct CoreStats {
+    u64 nCoherenceMiss = 0;     // Misses on blocks invalidated by a peer
+    u64 nInvalidations = 0;     // Lines invalidated by peers
+    u64 nTransfers = 0;         // Fills supplied by a peer cache
+    u64 nCoherenceWb = 0;       // Writebacks forced by a peer read (M -> S)
+};
+
+class EpochBarrier {
+public:
+    mutex m;
+    condition_variable cv;
+    int nThreads;
+    int nWaiting = 0;
+    u64 generation = 0;
+
+    EpochBarrier(int nThreads) : nThreads(nThreads) {}
+
+    void wait() {
+        unique_lock<mutex> lock(m);
+        u64 gen = generation;
+        if (++nWaiting == nThreads) {
+            nWaiting = 0;
+            generation++;
+            cv.notify_all();
+        } else {
+            cv.wait(lock, [&] { return gen != generation; });
+        }
+    }
+};
+
+const u32 EPOCH_SHARED = ~0u;
+const int MAX_CORES = 64;
+
+class MultiCoreSim {
+public:
+    int nCores;
+    u64 lenOffset;
+    u64 epochLen;
+    vector<Cache*> caches;
+    vector<CoreStats> coreStats;
+
+    vector<vector<Instr> > instrs;  // Per-core streams
+    vector<u8> order;               // Global interleaving, as core ids
+
+    FlatHashMap<DirEntry> directory;
+    vector<FlatHashMap<u8> > invalidated;   // Per core, blocks lost to peers
+    FlatHashMap<u32> epochBlocks;           // Block -> core, or EPOCH_SHARED
+
+    // Per-core progress within the current epoch
+    vector<u64> done;
+    vector<u64> epochEnd;
+
+    MultiCoreSim(int nCores, u64 blockSize, u64 numWays,
+                 ReplacementPolicy replacementPolicy, u64 epochLen = 1 << 16)
+    :
+        nCores(nCores),
+        epochLen(epochLen),
+        coreStats(nCores),
+        instrs(nCores),
+        invalidated(nCores),
+        done(nCores, 0),
+        epochEnd(nCores, 0)
+    {
+        assert(nCores > 0 && nCores <= MAX_CORES);
+        for (int c = 0; c < nCores; ++c) {
+            caches.push_back(new Cache(blockSize, numWays, replacementPolicy, back_alloc));
+        }
+        lenOffset = caches[0]->lenOffset;
+    }
+
+    ~MultiCoreSim() {
+        for (Cache* cache : caches) delete cache;
+    }
+
+    void addInstr(int core, const Instr& instr) {
+        assert(core >= 0 && core < nCores);
+        instrs[core].push_back(instr);
+        order.push_back((u8) core);
+    }
+
+    void run(int nThreads) {
+        for (int c = 0; c < nCores; ++c) {
+            caches[c]->rm->onTrace(instrs[c], lenOffset, nullptr);
+        }
+        if (nThreads > nCores) nThreads = nCores;
+        if (nThreads < 1) nThreads = 1;
+
+        EpochBarrier barrier(nThreads + 1);
+        bool finished = false;
+        vector<thread> workers;
+        for (int w = 0; w < nThreads; ++w) {
+            workers.push_back(thread([&, w] {
+                while (true) {
+                    barrier.wait();     // Epoch start
+                    if (finished) break;
+                    for (int c = w; c < nCores; c += nThreads) {
+                        runPrivate(c);
+                    }
+                    barrier.wait();     // Epoch end
+                }
+            }));
+        }
+
+        vector<u64> start(nCores, 0);
+        for (u64 pos = 0; pos < order.size(); pos += epochLen) {
+            u64 end = pos + epochLen < order.size() ? pos + epochLen : order.size();
+            prepareEpoch(pos, end, start);
+
+            barrier.wait();
+            barrier.wait();
+
+            // Serial replay of what the private phase left, in global order
+            vector<u64> next(start);
+            for (u64 i = pos; i < end; ++i) {
+                int c = order[i];
+                u64 k = next[c]++;
+                if (k >= done[c]) {
+                    step(c, instrs[c][k]);
+                }
+            }
+            start = next;
+        }
+
+        finished = true;
+        barrier.wait();
+        for (thread& t : workers) t.join();
+    }
+
+private:
+    DirEntry* lookup(u64 block) {
+        return directory.find(block);
+    }
+
+    void prepareEpoch(u64 pos, u64 end, const vector<u64>& start) {
+        epochBlocks.reset(end - pos);
+        vector<u64> k(start);
+        for (u64 i = pos; i < end; ++i) {
+            int c = order[i];
+            u64 block = instrs[c][k[c]++].addr >> lenOffset;
+            u32& owner = epochBlocks.findOrInsert(block, (u32) c);
+            if (owner != (u32) c) owner = EPOCH_SHARED;
+        }
+        for (int c = 0; c < nCores; ++c) {
+            done[c] = start[c];
+            epochEnd[c] = k[c];
+        }
+    }
+
+    // Runs core c's accesses while they are private hits. Only touches
+    // core c's cache and reads the directory, so cores run concurrently.
+    void runPrivate(int c) {
+        Cache& cache = *caches[c];
+        u64 k = done[c];
+        for (; k < epochEnd[c]; ++k) {
+            Instr& instr = instrs[c][k];
+            u64 block = instr.addr >> lenOffset;
+            if (*epochBlocks.find(block) == EPOCH_SHARED) break;
+            if (cache.findLine(instr.addr) == -1) break;
+            if (!instr.isread && !lookup(block)->exclusive) break;
+            cache.processInstr(instr);
+        }
+        done[c] = k;
+    }
+
+    void step(int c, Instr& instr) {
+        Cache& cache = *caches[c];
+        u64 block = instr.addr >> lenOffset;
+        u64 self = 1ull << c;
+        bool hit = cache.findLine(instr.addr) != -1;
+        DirEntry* e = lookup(block);
+
+        bool transfer = false;
+        if (!hit && invalidated[c].erase(block)) {
+            coreStats[c].nCoherenceMiss++;
+        }
+
+        if (instr.isread) {
+            if (!hit) {
+                if (e != nullptr && (e->sharers & ~self)) {
+                    // A peer supplies the block, an exclusive owner drops to S
+                    coreStats[c].nTransfers++;
+                    transfer = true;
+                    if (e->exclusive) {
+                        int owner = __builtin_ctzll(e->sharers);
+                        if (caches[owner]->clean(instr.addr)) {
+                            coreStats[owner].nCoherenceWb++;
+                        }
+                        e->exclusive = false;
+                    }
+                    e->sharers |= self;
+                } else {
+                    DirEntry& entry = directory.findOrInsert(block);
+                    entry.sharers = self;
+                    entry.exclusive = true;
+                }
+            }
+        } else if (!hit || !e->exclusive) {
+            // Read-for-ownership or upgrade: invalidate all other holders.
+            // A dirty copy moves to the requester, so memory is not written.
+            u64 others = e != nullptr ? e->sharers & ~self : 0;
+            if (!hit && others) {
+                coreStats[c].nTransfers++;
+                transfer = true;
+            }
+            for (int o = 0; o < nCores; ++o) {
+                if (others & (1ull << o)) {
+                    caches[o]->invalidate(instr.addr);
+                    invalidated[o].insert(block, 1);
+                    coreStats[o].nInvalidations++;
+                }
+            }
+            DirEntry& entry = directory.findOrInsert(block);
+            entry.sharers = self;
+            entry.exclusive = true;
+        }
+
+        cache.lastEvicted = EMPTY_KEY;
+        u8 accessInfo = cache.processInstr(instr);
+        if (transfer && (accessInfo & LOG_REPLACE)) {
+            // The fill came from the peer, memory was not read
+            if (cache.keepLog) cache.log.back() &= ~LOG_REPLACE;
+            cache.nReadBytes -= cache.sectorSize;
+        }
+        if (cache.lastEvicted != EMPTY_KEY) {
+            DirEntry* evicted = lookup(cache.lastEvicted);
+            assert(evicted != nullptr);
+            evicted->sharers &= ~self;
+            if (evicted->sharers == 0) {
+                directory.erase(cache.lastEvicted);
+            }
+        }
+    }
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include "global.hpp"
+
+using namespace std;
+
+/*
+    Open-addressing hash map keyed by u64 (block addresses), using linear
+    probing over a flat power-of-two table. Much more compact and cache
+    friendly than unordered_map for the per-block shadow structures.
+
+    NOTE: EMPTY_KEY (all ones) is reserved and cannot be used as a key.
+*/
+const u64 EMPTY_KEY = ~0ull;
+
+inline u64 hashU64(u64 key) {
+    // splitmix64 finalizer
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+template<class V>
+class FlatHashMap {
+public:
+    vector<u64> keys;
+    vector<V> vals;
+    u64 mask;
+    u64 nElems;
+
+    FlatHashMap(u64 capacity = 16) {
+        reset(capacity);
+    }
+
+    void reset(u64 capacity) {
+        // Keep load factor below 1/2
+        u64 nSlots = 16;
+        while (nSlots < 2 * capacity) nSlots <<= 1;
+        keys.assign(nSlots, EMPTY_KEY);
+        vals.assign(nSlots, V());
+        mask = nSlots - 1;
+        nElems = 0;
+    }
+
+    u64 size() const { return nElems; }
+
+    V* find(u64 key) {
+        for (u64 i = hashU64(key) & mask; ; i = (i + 1) & mask) {
+            if (keys[i] == key) return &vals[i];
+            if (keys[i] == EMPTY_KEY) return nullptr;
+        }
+    }
+
+    bool contains(u64 key) {
+        return find(key) != nullptr;
+    }
+
+    // Returns the value for key, inserting `init` if absent. The reference
+    // stays valid until the next insertion.
+    V& findOrInsert(u64 key, const V& init = V()) {
+        assert(key != EMPTY_KEY);
+        if (2 * (nElems + 1) > keys.size()) grow();
+        u64 i = hashU64(key) & mask;
+        for (; keys[i] != EMPTY_KEY; i = (i + 1) & mask) {
+            if (keys[i] == key) return vals[i];
+        }
+        keys[i] = key;
+        vals[i] = init;
+        nElems++;
+        return vals[i];
+    }
+
+    V& operator[](u64 key) {
+        return findOrInsert(key);
+    }
+
+    // Returns true if the key was newly inserted
+    bool insert(u64 key, const V& val) {
+        u64 oldSize = nElems;
+        findOrInsert(key) = val;
+        return nElems != oldSize;
+    }
+
+    bool erase(u64 key) {
+        u64 i = hashU64(key) & mask;
+        for (; keys[i] != key; i = (i + 1) & mask) {
+            if (keys[i] == EMPTY_KEY) return false;
+        }
+        // Backward-shift deletion keeps probe sequences intact without
+        // tombstones.
+        u64 j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (keys[j] == EMPTY_KEY) break;
+            u64 home = hashU64(keys[j]) & mask;
+            // Move keys[j] into the hole at i if its home slot is not in (i, j]
+            bool between = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!between) {
+                keys[i] = keys[j];
+                vals[i] = vals[j];
+                i = j;
+            }
+        }
+        keys[i] = EMPTY_KEY;
+        nElems--;
+        return true;
+    }
+
+    void clear() {
+        keys.assign(keys.size(), EMPTY_KEY);
+        nElems = 0;
+    }
+
+    u64 getNBytes() const {
+        return keys.size() * (sizeof(u64) + sizeof(V));
+    }
+
+private:
+    void grow() {
+        vector<u64> oldKeys;
+        vector<V> oldVals;
+        oldKeys.swap(keys);
+        oldVals.swap(vals);
+        reset(oldKeys.size());
+        for (u64 i = 0; i < oldKeys.size(); ++i) {
+            if (oldKeys[i] != EMPTY_KEY) {
+                findOrInsert(oldKeys[i], oldVals[i]);
+            }
+        }
+    }
+};
+
+
+/*
+    Set counterpart of FlatHashMap, storing keys only.
+*/
+class FlatHashSet {
+public:
+    vector<u64> keys;
+    u64 mask;
+    u64 nElems;
+
+    FlatHashSet(u64 capacity = 16) {
+        reset(capacity);
+    }
+
+    void reset(u64 capacity) {
+        u64 nSlots = 16;
+        while (nSlots < 2 * capacity) nSlots <<= 1;
+        keys.assign(nSlots, EMPTY_KEY);
+        mask = nSlots - 1;
+        nElems = 0;
+    }
+
+    u64 size() const { return nElems; }
+
+    bool contains(u64 key) const {
+        for (u64 i = hashU64(key) & mask; ; i = (i + 1) & mask) {
+            if (keys[i] == key) return true;
+            if (keys[i] == EMPTY_KEY) return false;
+        }
+    }
+
+    // Returns true if the key was newly inserted
+    bool insert(u64 key) {
+        assert(key != EMPTY_KEY);
+        if (2 * (nElems + 1) > keys.size()) grow();
+        u64 i = hashU64(key) & mask;
+        for (; keys[i] != EMPTY_KEY; i = (i + 1) & mask) {
+            if (keys[i] == key) return false;
+        }
+        keys[i] = key;
+        nElems++;
+        return true;
+    }
+
+    void clear() {
+        keys.assign(keys.size(), EMPTY_KEY);
+        nElems = 0;
+    }
+
+    u64 getNBytes() const {
+        return keys.size() * sizeof(u64);
+    }
+
+private:
+    void grow() {
+        vector<u64> oldKeys;
+        oldKeys.swap(keys);
+        reset(oldKeys.size());
+        for (u64 key : oldKeys) {
+            if (key != EMPTY_KEY) insert(key);
+        }
+    }
+};
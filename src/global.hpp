@@ -10,11 +10,13 @@ using i64 = long long;
 
 const u64 CACHE_SIZE    = 128 * 1024; // 128KB
 const u64 ADDR_LEN      = 64;
+const u64 WORD_SIZE     = 4;  // Bytes touched by one trace access
 const u8 LOG_HIT        = 0b0000'0001;
 const u8 LOG_READ_MEM   = 0b0000'0010;
 const u8 LOG_WRITE_MEM  = 0b0000'0100;
 const u8 LOG_REPLACE    = 0b0000'1000;
 
 
-enum ReplacementPolicy { binTree, LRU, PLRU, replaceNull };
+enum ReplacementPolicy { binTree, LRU, PLRU, OPT, replaceNull };
 enum WritePolicy { through_alloc, through_noAlloc, back_alloc, back_noAlloc, writeNull };
+enum IndexFunction { indexBits, indexXor, indexPrime, indexSkew, indexNull };
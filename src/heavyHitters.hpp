@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+/*
+    Space-Saving heavy-hitters sketch over a stream of u64 items.
+
+    Keeps at most k counters in fixed memory. When a new item arrives and
+    all counters are taken, the item with the smallest count is replaced and
+    the new item inherits that count (recorded as its error bound). Any item
+    with true frequency > N / k is guaranteed to be tracked.
+
+    Counters are kept in an indexed min-heap so every update is O(log k).
+*/
+class SpaceSaving {
+public:
+    u64 k;
+    vector<u64> items;
+    vector<u64> counts;
+    vector<u64> errors;     // Overestimation bound of each count
+    vector<u32> heap;       // Min-heap of slots, keyed by count
+    vector<u32> pos;        // Position of each slot in heap
+    u32 nUsed = 0;
+    u64 nTotal = 0;
+    FlatHashMap<u32> slots;
+
+    SpaceSaving(u64 k)
+    :
+        k(k),
+        items(k),
+        counts(k, 0),
+        errors(k, 0),
+        heap(k),
+        pos(k),
+        slots(k)
+    {
+        assert(k > 0);
+    }
+
+    void add(u64 item) {
+        nTotal++;
+        u32* slot = slots.find(item);
+        if (slot != nullptr) {
+            counts[*slot]++;
+            siftDown(pos[*slot]);
+            return;
+        }
+
+        if (nUsed < k) {
+            u32 s = nUsed++;
+            items[s] = item;
+            counts[s] = 1;
+            errors[s] = 0;
+            heap[s] = s;
+            pos[s] = s;
+            slots.insert(item, s);
+            siftUp(s);
+        } else {
+            // Evict the item with the smallest count
+            u32 s = heap[0];
+            slots.erase(items[s]);
+            items[s] = item;
+            errors[s] = counts[s];
+            counts[s]++;
+            slots.insert(item, s);
+            siftDown(0);
+        }
+    }
+
+    // Slots sorted by descending count
+    vector<u32> getTop() const {
+        vector<u32> ret(heap.begin(), heap.begin() + nUsed);
+        sort(ret.begin(), ret.end(), [this](u32 a, u32 b) {
+            return counts[a] > counts[b];
+        });
+        return ret;
+    }
+
+private:
+    void swapAt(u32 a, u32 b) {
+        u32 t = heap[a];
+        heap[a] = heap[b];
+        heap[b] = t;
+        pos[heap[a]] = a;
+        pos[heap[b]] = b;
+    }
+
+    void siftUp(u32 p) {
+        while (p > 0) {
+            u32 parent = (p - 1) / 2;
+            if (counts[heap[parent]] <= counts[heap[p]]) break;
+            swapAt(p, parent);
+            p = parent;
+        }
+    }
+
+    void siftDown(u32 p) {
+        while (true) {
+            u32 smallest = p;
+            u32 l = 2 * p + 1;
+            u32 r = l + 1;
+            if (l < nUsed && counts[heap[l]] < counts[heap[smallest]]) smallest = l;
+            if (r < nUsed && counts[heap[r]] < counts[heap[smallest]]) smallest = r;
+            if (smallest == p) break;
+            swapAt(p, smallest);
+            p = smallest;
+        }
+    }
+};
+
+
+/*
+    Tracks the top-k block addresses by misses and by dirty writebacks.
+*/
+class HotBlockTracker {
+public:
+    u64 lenOffset;
+    SpaceSaving misses;
+    SpaceSaving writebacks;
+
+    HotBlockTracker(u64 k, u64 lenOffset)
+    :
+        lenOffset(lenOffset),
+        misses(k),
+        writebacks(k)
+    {}
+
+    void onMiss(u64 block) {
+        misses.add(block);
+    }
+
+    void onWriteback(u64 block) {
+        writebacks.add(block);
+    }
+
+    void writeReport(string filename) {
+        ofstream fout(filename);
+        if (!fout.is_open()) {
+            printf("Error opening output file\n");
+            assert(false);
+        }
+        fout << "kind\trank\tblock addr\tcount\terror\tshare\n";
+        writeSketch(fout, "miss", misses);
+        writeSketch(fout, "writeback", writebacks);
+        cout << "Saved hot blocks to " << filename << endl;
+    }
+
+private:
+    void writeSketch(ofstream& fout, const char* kind, const SpaceSaving& sketch) {
+        vector<u32> top = sketch.getTop();
+        for (int rank = 0; rank < (int) top.size(); ++rank) {
+            u32 s = top[rank];
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%s\t%d\t0x%llx\t%llu\t%llu\t%.2f\n",
+                     kind, rank + 1, sketch.items[s] << lenOffset,
+                     sketch.counts[s], sketch.errors[s],
+                     100.0 * sketch.counts[s] / sketch.nTotal);
+            fout << buf;
+        }
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "global.hpp"
+
+/*
+    Cycle estimation from the per-access log bits, applied incrementally
+    as the trace is processed.
+
+    Every access costs hitLatency. A memory read (LOG_REPLACE) adds
+    missPenalty and a memory write (LOG_WRITE_MEM) adds writebackCost.
+    Memory transfers occupy the bus for bytes / bytesPerCycle cycles, the
+    bytes being those the access actually moves (a word for a write
+    through, a sector for a sector fill, the dirty sectors of a write
+    back); a read that finds the bus busy stalls until it frees up, which
+    is reported separately as bandwidth stall cycles. Background traffic
+    such as prefetch fills and write buffer drains only occupies the bus.
+*/
+class LatencyModel {
+public:
+    u64 hitLatency;
+    u64 missPenalty;
+    u64 writebackCost;
+    double bytesPerCycle;
+
+    u64 nAccess = 0;
+    double cycles = 0;
+    double stallCycles = 0;
+    double memFreeAt = 0;
+
+    LatencyModel(u64 hitLatency, u64 missPenalty, u64 writebackCost, double bytesPerCycle)
+    :
+        hitLatency(hitLatency),
+        missPenalty(missPenalty),
+        writebackCost(writebackCost),
+        bytesPerCycle(bytesPerCycle)
+    {}
+
+    inline void onAccess(u8 accessInfo, u64 readBytes, u64 writeBytes) {
+        nAccess++;
+        cycles += hitLatency;
+        if (accessInfo & (LOG_REPLACE | LOG_WRITE_MEM)) {
+            onMemAccess(accessInfo, readBytes + writeBytes);
+        }
+    }
+
+    void onMemAccess(u8 accessInfo, u64 bytes) {
+        bool memRead = accessInfo & LOG_REPLACE;
+        bool memWrite = accessInfo & LOG_WRITE_MEM;
+        double start = memFreeAt > cycles ? memFreeAt : cycles;
+        memFreeAt = start + bytes / bytesPerCycle;
+        if (memRead) {
+            stallCycles += start - cycles;
+            cycles = start + missPenalty;
+        }
+        if (memWrite) {
+            cycles += writebackCost;
+        }
+    }
+
+    // Transfers that keep the bus busy without stalling the access stream
+    void onBackground(u64 bytes) {
+        if (bytes == 0) return;
+        double start = memFreeAt > cycles ? memFreeAt : cycles;
+        memFreeAt = start + bytes / bytesPerCycle;
+    }
+
+    double getAmat() const {
+        return nAccess == 0 ? 0.0 : cycles / nAccess;
+    }
+};
@@ -1,12 +1,20 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
 
 #include "global.hpp"
 #include "cache.hpp"
+#include "coherence.hpp"
+#include "resultCache.hpp"
+#include "resultStore.hpp"
+#include "threadPool.hpp"
+#include "verifier.hpp"
+#include "tlb.hpp"
+#include "tenants.hpp"
 #include "instr.hpp"
 #include "utils.hpp"
 
@@ -31,20 +39,56 @@ void readFile(string inFile, vector<Instr>& res) {
     }
 }
 
-void writeFile(string statsFile, vector<vector<float> >& stats) {
+/*
+    A stats column is its header name and the number of decimals printed.
+    Rows of stats hold one value per column.
+*/
+struct StatsColumn {
+    string name;
+    int precision;
+};
+
+// Multi-core traces tag each access with its core: "<core> <addr> <r|w>"
+void readTaggedFile(string inFile, MultiCoreSim& sim) {
+    ifstream fin(inFile);
+    int core;
+    string strAddr;
+    char cmd;
+    if (fin.is_open()) {
+        while (true) {
+            fin >> core >> strAddr >> cmd;
+            if (fin.eof()) break;
+            sim.addInstr(core, Instr(cmd == 'r', toBin(strAddr)));
+        }
+    }
+}
+
+// Written to a temporary file first and renamed, so readers never see a
+// partial stats file
+void writeFile(string statsFile, vector<StatsColumn>& columns, vector<vector<double> >& stats) {
     cout << "opening file: " << statsFile << endl;
-    ofstream fout(statsFile);
+    string tmpFile = statsFile + ".tmp";
+    ofstream fout(tmpFile);
     if (fout.is_open()) {
-        string header = "trace id\tcache space\treplace space\taccess count\tmiss rate\twrite mem count\tread mem count\tread miss\n";
+        string header = columns[0].name;
+        for (int i = 1; i < (int) columns.size(); ++i) {
+            header += '\t' + columns[i].name;
+        }
+        header += '\n';
         fout.write(header.c_str(), header.size());
         for (auto& line : stats) {
-            char buf[512];
-            snprintf(buf, sizeof(buf), "%.0f\t%.0f\t%.0f\t%.0f\t%.1f\t%.0f\t%.0f\t%.0f\n", 
-                     line[0], line[1], line[2], line[3], 100.0 * line[4], line[5], line[6], line[7]);
-            // string row = join<double>(line, '\t') + '\n';
-            string row = buf;
+            string row;
+            for (int i = 0; i < (int) line.size(); ++i) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), "%.*f", columns[i].precision, line[i]);
+                if (i > 0) row += '\t';
+                row += buf;
+            }
+            row += '\n';
             fout.write(row.c_str(), row.size());
         }
+        fout.close();
+        rename(tmpFile.c_str(), statsFile.c_str());
     } else {
         printf("Error opening output file\n");
         assert(false);
@@ -52,22 +96,84 @@ void writeFile(string statsFile, vector<vector<float> >& stats) {
     cout << "Saved result to " << statsFile << endl;
 }
 
-ReplacementPolicy sToReplace(const char* s) {
-    string str(s);
-    if (str == "binTree") return binTree;
-    if (str == "LRU") return LRU;
-    if (str == "PLRU") return PLRU;
+/*
+    The configuration of a run: its arguments that determine the results,
+    joined by spaces. --no-memo, --no-tsv and --runs change nothing, and
+    neither does --fuse for each of the policies it reports. Memo keys,
+    the result store and output file names all use it, so grid and
+    single runs of one configuration share them.
+*/
+string resultConfig(const vector<string>& args) {
+    string config;
+    for (const string& arg : args) {
+        if (arg != "--no-memo" && arg != "--no-tsv" && arg != "--fuse" && arg != "--runs") {
+            config += (config.empty() ? "" : " ") + arg;
+        }
+    }
+    return config;
+}
+
+// Output files are named after the arguments that determine their results,
+// with spaces (and the '/' of way masks) turned into '_'
+string toFileName(string config) {
+    replace(config.begin(), config.end(), ' ', '_');
+    replace(config.begin(), config.end(), '/', '_');
+    return config;
+}
+
+// Columns of every single-core stats file, optional features add more
+vector<StatsColumn> baseColumns() {
+    return vector<StatsColumn> {
+        {"trace id", 0},
+        {"cache space", 0},
+        {"replace space", 0},
+        {"access count", 0},
+        {"miss rate", 1},
+        {"write mem count", 0},
+        {"read mem count", 0},
+        {"read miss", 0},
+        {"read mem bytes", 0},
+        {"write mem bytes", 0}
+    };
+}
+
+vector<double> baseRow(int traceId, Cache& cache) {
+    return vector<double> {
+        (double) traceId,
+        (double) cache.nBytes,
+        (double) cache.rm->getNBytes(),
+        (double) cache.getAccessCnt(),
+        (double) (100.0 * cache.getMissRate()),
+        (double) cache.getWriteMemCnt(),
+        (double) cache.getReadMemCnt(),
+        (double) cache.nReadMiss,
+        (double) cache.nReadBytes,
+        (double) cache.getWriteMemBytes()
+    };
+}
+
+// Under interval sampling the base columns hold whole-trace estimates
+void applyEstimates(vector<double>& row, IntervalSampler& sampler, u64 nAccess) {
+    row[3] = (double) nAccess;
+    row[4] = (double) (100.0 * sampler.getMean(sampleMiss));
+    row[5] = (double) (sampler.getMean(sampleWriteMem) * nAccess);
+    row[6] = (double) (sampler.getMean(sampleReadMem) * nAccess);
+    row[7] = (double) (sampler.getMean(sampleReadMiss) * nAccess);
+    row[8] = (double) (sampler.getMean(sampleReadBytes) * nAccess);
+    row[9] = (double) (sampler.getMean(sampleWriteBytes) * nAccess);
+}
 
-    return replaceNull;
+Prefetcher* makePrefetcher(string type, u64 degree, u64 lenOffset) {
+    if (type == "nextline") return new PFNextLine(degree);
+    if (type == "stride") return new PFStride(degree, lenOffset);
+    if (type == "stream") return new PFStream(degree);
+    return nullptr;
 }
 
-WritePolicy sToWrite(const char* s) {
-    string str(s);
-    if (str == "back_alloc") return back_alloc;
-    if (str == "back_noAlloc") return back_noAlloc;
-    if (str == "through_alloc") return through_alloc;
-    if (str == "through_noAlloc") return through_noAlloc;
-    return writeNull;
+DrainPolicy sToDrain(const string& str) {
+    if (str == "fifo") return drainFifo;
+    if (str == "threshold") return drainThreshold;
+    return drainNull;
 }
 
 void testLayout(vector<Instr>* instrs) {
@@ -91,63 +197,125 @@ string join(vector<T> v, char c) {
     return ret;
 }
 
-void cntIndex(vector<Instr>& instrs, Cache& cache) {
-    unordered_map<u64, u64> cnt;
-
-    for (Instr& instr : instrs) {
-        u64 index = cache.getIndex(instr.addr);
-        cnt[index] ++;
-    }
-
-    for (auto& it : cnt) {
-        u64 index = it.first;
-        u64 c = it.second;
-        if (c > 5) {
-            cout << index << ": " << c << endl;
-        }
-    }
-}
-
-void cnt(vector<Instr>& instrs, Cache& cache) {
-    unordered_map<u64, unordered_set<u64>> cnt;
-
-    for (Instr& instr : instrs) {
-        u64 index = cache.getIndex(instr.addr);
-        u64 tag = cache.getTag(instr.addr);
-        if (cnt.find(index) == cnt.end()) {
-            cnt[index] = unordered_set<u64>();
-        }
-        cnt[index].insert(tag);
-    }
-
-    for (auto& it : cnt) {
-        u64 index = it.first;
-        auto s = it.second;
-        if (s.size() > 2) {
-            cout << index << ": ";
-            cout << s.size() << " ";
-            for (u64 a : s) {
-                cout << a << " ";
-            }
-            cout << endl;
-            // cout << index << ": " << s.size() << endl;
-        }
-    }
-}
-
 int blockSize = 8;
 int numWays = 4;
 ReplacementPolicy replacementPolicy = binTree;
 WritePolicy writePolicy = back_alloc;
 
+// Optional features, enabled by flags after the 4 positional arguments
+bool classifyMisses = false;
+int hotBlocksK = 0;     // 0 disables hot block tracking
+bool collectSetStats = false;
+string prefetchType = "";   // Empty disables prefetching
+int prefetchDegree = 1;
+int writeBufferEntries = 0;     // 0 disables the write buffer
+DrainPolicy drainPolicy = drainFifo;
+int drainInterval = 2;
+int victimEntries = 0;      // 0 disables the victim cache
+bool estimateCycles = false;
+u64 hitLatency = 1;
+u64 missPenalty = 100;
+u64 writebackCost = 10;
+double bytesPerCycle = 8.0;
+int nMshrs = 0;         // 0 leaves out the non-blocking timing model
+int nCores = 0;         // 0 runs the single-core simulation
+int nThreads = 0;       // 0 uses all hardware threads
+bool memoResults = true;
+bool exportTsv = true;  // Stats files next to the result store
+string gridFile = "";   // Set by --grid, runs every configuration in the file
+IndexFunction indexFunction = indexBits;
+bool fuseWritePolicies = false;
+int sectorSize = 0;     // 0 makes the whole block one sector
+int windowLen = 0;      // 0 disables windowed statistics
+bool adaptiveWindows = false;
+bool verify = false;    // Check every access against the reference model
+u64 verifyWindow = 0;   // With a period, only check windows of accesses
+u64 verifyPeriod = 0;
+int tlbL1Entries = 0;   // 0 uses trace addresses as physical addresses
+int tlbL2Entries = 1024;
+u64 pageSize = 4096;
+PageAlloc pageAlloc = allocSequential;
+u64 warmupLen = 0;      // 0 counts every access
+bool warmupUntilFull = false;
+bool collapseRuns = false;  // Apply runs of accesses to one block at once
+u64 sampleUnit = 0;     // 0 simulates every access in detail
+u64 samplePeriod = 0;
+u64 sampleWarm = 0;
+// Multi-tenant mode, one entry per tenant
+vector<int> tenantTraces;
+vector<u64> tenantRates;
+vector<u64> tenantMasks;
+
 int parse_args(int argc, char** argv) {
-    if (argc != 5) {
+    if (argc >= 3 && string(argv[1]) == "--grid") {
+        gridFile = argv[2];
+        for (int i = 3; i < argc; ++i) {
+            string flag(argv[i]);
+            if (flag == "--threads" && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                nThreads = atoi(argv[++i]);
+            } else if (flag == "--no-memo") {
+                memoResults = false;
+            } else if (flag == "--no-tsv") {
+                exportTsv = false;
+            } else {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (argc < 5) {
        cout << "ERROR: Must pass in 4 arguments: \n";
        cout << "1. block size\n";
        cout << "2. number of ways\n";
        cout << "3. replacement policy\n";
        cout << "4. write policy\n";
        cout << "NOTE: Order matters\n";
+       cout << "Or: --grid <file> [--threads <T>] [--no-memo] [--no-tsv] to run a grid of experiments\n";
+       cout << "Optional flags:\n";
+       cout << "  --classify    classify misses as compulsory/capacity/conflict\n";
+       cout << "  --hot <K>     report the top K blocks by misses and writebacks\n";
+       cout << "  --sets        write per-set pressure statistics as a CSV heatmap\n";
+       cout << "  --prefetch <nextline|stride|stream>[:degree]\n";
+       cout << "                enable a hardware prefetcher model\n";
+       cout << "  --wbuf <entries>[:<fifo|threshold>[:<drain interval>]]\n";
+       cout << "                coalescing write buffer (write-through only)\n";
+       cout << "  --victim <entries>\n";
+       cout << "                victim cache of 4-64 entries behind the cache\n";
+       cout << "  --latency [<hit>:<miss penalty>:<writeback>:<bytes per cycle>]\n";
+       cout << "                estimate cycles and AMAT (default 1:100:10:8)\n";
+       cout << "  --mshr <N>    non-blocking timing with N MSHRs, using the --latency\n";
+       cout << "                parameters: cycles, MLP and MSHR occupancy\n";
+       cout << "  --cores <N>   MESI-coherent private caches, one per core, fed by\n";
+       cout << "                tagged traces ../input/<i>.mtrace (back_alloc only)\n";
+       cout << "  --threads <T> worker threads for --cores\n";
+       cout << "  --index <bits|xor|prime|skew>\n";
+       cout << "                set index function (skew requires LRU)\n";
+       cout << "  --sector <bytes>\n";
+       cout << "                sector size, lines fill and write back per sector\n";
+       cout << "  --window <N>[:adaptive]\n";
+       cout << "                statistics every N accesses, with phase detection\n";
+       cout << "  --fuse        also report the write policy with the same allocation\n";
+       cout << "                and the other write hit policy, from the same run\n";
+       cout << "  --tlb [<L1 entries>:<L2 entries>[:<4k|2m|1g>[:<seq|random|color>]]]\n";
+       cout << "                translate addresses through a two-level TLB first\n";
+       cout << "                (default 64:1024:4k:seq)\n";
+       cout << "  --sample <unit>:<period>[:<warming>]\n";
+       cout << "                measure <unit> of every <period> accesses, after\n";
+       cout << "                <warming> accesses of functional warming (default all)\n";
+       cout << "  --tenants <trace>[@<rate>][/<way mask>],...\n";
+       cout << "                interleave traces into one shared cache, optionally\n";
+       cout << "                way partitioned, with per-tenant statistics\n";
+       cout << "  --warmup <N|full>\n";
+       cout << "                only warm the cache with the first N accesses, or until\n";
+       cout << "                it is full (at most half the trace), before counting\n";
+       cout << "  --runs        apply runs of accesses to the same block at once\n";
+       cout << "  --verify [<window>:<period>]\n";
+       cout << "                check against a reference model, in lockstep or on\n";
+       cout << "                the first <window> of every <period> accesses\n";
+       cout << "  --no-memo     always simulate, ignoring results in ../output/cache\n";
+       cout << "  --no-tsv      only append stats to ../output/results.db, without\n";
+       cout << "                writing the TSV files\n";
        return -1;
     }
     blockSize = atoi(argv[1]);
@@ -162,9 +330,596 @@ int parse_args(int argc, char** argv) {
        cout << "Invalid argument: " << argv[4] << endl;
        return -1;
     }
+    for (int i = 5; i < argc; ++i) {
+        string flag(argv[i]);
+        if (flag == "--classify") {
+            classifyMisses = true;
+        } else if (flag == "--no-memo") {
+            memoResults = false;
+        } else if (flag == "--no-tsv") {
+            exportTsv = false;
+        } else if (flag == "--sample" && i + 1 < argc) {
+            vector<string> parts = split(argv[++i], ':');
+            if (parts.size() < 2 || parts.size() > 3) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+            sampleUnit = atoll(parts[0].c_str());
+            samplePeriod = atoll(parts[1].c_str());
+            sampleWarm = parts.size() > 2 ? atoll(parts[2].c_str()) : samplePeriod - sampleUnit;
+            if (sampleUnit == 0 || sampleUnit > samplePeriod || sampleUnit + sampleWarm > samplePeriod) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--tenants" && i + 1 < argc) {
+            for (const string& spec : split(argv[++i], ',')) {
+                size_t at = spec.find('@');
+                size_t slash = spec.find('/');
+                int trace = atoi(spec.substr(0, min(at, slash)).c_str());
+                u64 rate = at == string::npos ? 1 : atoll(spec.substr(at + 1, slash - at - 1).c_str());
+                u64 mask = slash == string::npos ? ALL_WAYS : strtoull(spec.c_str() + slash + 1, nullptr, 0);
+                if (trace <= 0 || rate == 0 || mask == 0 || (at != string::npos && slash < at)) {
+                    cout << "Invalid argument: " << spec << endl;
+                    return -1;
+                }
+                tenantTraces.push_back(trace);
+                tenantRates.push_back(rate);
+                tenantMasks.push_back(mask);
+            }
+            if (tenantTraces.size() > MAX_TENANTS) {
+                cout << "At most " << MAX_TENANTS << " tenants\n";
+                return -1;
+            }
+        } else if (flag == "--warmup" && i + 1 < argc) {
+            string spec(argv[++i]);
+            warmupUntilFull = (spec == "full");
+            warmupLen = warmupUntilFull ? ~0ull : atoll(spec.c_str());
+            if (warmupLen == 0) {
+                cout << "Invalid argument: " << spec << endl;
+                return -1;
+            }
+        } else if (flag == "--runs") {
+            collapseRuns = true;
+        } else if (flag == "--fuse") {
+            fuseWritePolicies = true;
+        } else if (flag == "--sets") {
+            collectSetStats = true;
+        } else if (flag == "--prefetch" && i + 1 < argc) {
+            string spec(argv[++i]);
+            size_t colon = spec.find(':');
+            prefetchType = spec.substr(0, colon);
+            if (colon != string::npos) {
+                prefetchDegree = atoi(spec.c_str() + colon + 1);
+            }
+            if ((prefetchType != "nextline" && prefetchType != "stride" && prefetchType != "stream")
+                || prefetchDegree <= 0) {
+                cout << "Invalid argument: " << spec << endl;
+                return -1;
+            }
+            if (replacementPolicy == OPT) {
+                cout << "OPT cannot be combined with --prefetch\n";
+                return -1;
+            }
+        } else if (flag == "--wbuf" && i + 1 < argc) {
+            string spec(argv[++i]);
+            vector<string> parts = split(spec, ':');
+            writeBufferEntries = atoi(parts[0].c_str());
+            if (parts.size() > 1) drainPolicy = sToDrain(parts[1]);
+            if (parts.size() > 2) drainInterval = atoi(parts[2].c_str());
+            if (writeBufferEntries <= 0 || drainPolicy == drainNull || drainInterval <= 0) {
+                cout << "Invalid argument: " << spec << endl;
+                return -1;
+            }
+            if (isWriteBack(writePolicy)) {
+                cout << "--wbuf requires a write-through policy\n";
+                return -1;
+            }
+        } else if (flag == "--victim" && i + 1 < argc) {
+            victimEntries = atoi(argv[++i]);
+            if (victimEntries < 4 || victimEntries > 64) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--latency") {
+            estimateCycles = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                vector<string> parts = split(argv[++i], ':');
+                if (parts.size() != 4) {
+                    cout << "Invalid argument: " << argv[i] << endl;
+                    return -1;
+                }
+                hitLatency = atoll(parts[0].c_str());
+                missPenalty = atoll(parts[1].c_str());
+                writebackCost = atoll(parts[2].c_str());
+                bytesPerCycle = atof(parts[3].c_str());
+                if (bytesPerCycle <= 0) {
+                    cout << "Invalid argument: " << argv[i] << endl;
+                    return -1;
+                }
+            }
+        } else if (flag == "--mshr" && i + 1 < argc) {
+            nMshrs = atoi(argv[++i]);
+            if (nMshrs <= 0 || nMshrs > 1024) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--cores" && i + 1 < argc) {
+            nCores = atoi(argv[++i]);
+            if (nCores <= 0 || nCores > MAX_CORES) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+            if (writePolicy != back_alloc) {
+                cout << "--cores requires the back_alloc write policy\n";
+                return -1;
+            }
+        } else if (flag == "--threads" && i + 1 < argc) {
+            nThreads = atoi(argv[++i]);
+            if (nThreads <= 0) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--index" && i + 1 < argc) {
+            indexFunction = sToIndex(argv[++i]);
+            if (indexFunction == indexNull) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+            if (indexFunction != indexBits
+                && (numWays == 0 || (u64) numWays * blockSize == CACHE_SIZE)) {
+                cout << "--index has no effect on a fully associative cache\n";
+                return -1;
+            }
+            if (indexFunction == indexSkew && replacementPolicy != LRU) {
+                cout << "--index skew requires the LRU replacement policy\n";
+                return -1;
+            }
+        } else if (flag == "--sector" && i + 1 < argc) {
+            sectorSize = atoi(argv[++i]);
+            if (sectorSize <= 0 || (sectorSize & (sectorSize - 1)) != 0
+                || sectorSize > blockSize || blockSize / sectorSize > 64) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--window" && i + 1 < argc) {
+            vector<string> parts = split(argv[++i], ':');
+            windowLen = atoi(parts[0].c_str());
+            if (parts.size() > 1) adaptiveWindows = (parts[1] == "adaptive");
+            if (windowLen <= 0 || windowLen > (1 << 24)
+                || parts.size() > 2 || (parts.size() == 2 && !adaptiveWindows)) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (flag == "--tlb") {
+            tlbL1Entries = 64;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                vector<string> parts = split(argv[++i], ':');
+                tlbL1Entries = atoi(parts[0].c_str());
+                if (parts.size() > 1) tlbL2Entries = atoi(parts[1].c_str());
+                if (parts.size() > 2) pageSize = sToPageSize(parts[2]);
+                if (parts.size() > 3) pageAlloc = sToAlloc(parts[3]);
+                int l2Sets = tlbL2Entries / (int) TLB_L2_WAYS;
+                bool l2Valid = tlbL2Entries > 0 && (tlbL2Entries <= (int) TLB_L2_WAYS
+                    || (tlbL2Entries % TLB_L2_WAYS == 0 && (l2Sets & (l2Sets - 1)) == 0));
+                if (parts.size() < 2 || parts.size() > 4 || tlbL1Entries <= 0 || !l2Valid
+                    || pageSize == 0 || pageAlloc == allocNull) {
+                    cout << "Invalid argument: " << argv[i] << endl;
+                    return -1;
+                }
+            }
+        } else if (flag == "--verify") {
+            verify = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                vector<string> parts = split(argv[++i], ':');
+                if (parts.size() != 2) {
+                    cout << "Invalid argument: " << argv[i] << endl;
+                    return -1;
+                }
+                verifyWindow = atoll(parts[0].c_str());
+                verifyPeriod = atoll(parts[1].c_str());
+                if (verifyWindow == 0 || verifyWindow > verifyPeriod) {
+                    cout << "Invalid argument: " << argv[i] << endl;
+                    return -1;
+                }
+            }
+        } else if (flag == "--hot" && i + 1 < argc) {
+            hotBlocksK = atoi(argv[++i]);
+            if (hotBlocksK <= 0) {
+                cout << "Invalid argument: " << argv[i] << endl;
+                return -1;
+            }
+        } else {
+            cout << "Invalid argument: " << argv[i] << endl;
+            return -1;
+        }
+    }
+    if (fuseWritePolicies && (hotBlocksK > 0 || collectSetStats || prefetchType != ""
+            || writeBufferEntries > 0 || victimEntries > 0 || estimateCycles || nMshrs > 0
+            || nCores > 0 || windowLen > 0 || verify)) {
+        // --verify would only check the write-back cache, not the derived row
+        cout << "--fuse only combines with --classify, --index, --sector, --tlb, --warmup and --runs\n";
+        return -1;
+    }
+    if (sectorSize > 0 && sectorSize < blockSize && (victimEntries > 0 || prefetchType != "")) {
+        cout << "--sector cannot be combined with --victim or --prefetch\n";
+        return -1;
+    }
+    if (collapseRuns && (replacementPolicy == OPT || prefetchType != "" || writeBufferEntries > 0
+            || nCores > 0 || verify || (sectorSize > 0 && sectorSize < blockSize))) {
+        cout << "--runs cannot be combined with OPT, --prefetch, --wbuf, --sector, --cores or --verify\n";
+        return -1;
+    }
+    // Features that count every access, or that warming would bypass
+    if (sampleUnit > 0 && (replacementPolicy == OPT || prefetchType != "" || writeBufferEntries > 0
+            || victimEntries > 0 || (sectorSize > 0 && sectorSize < blockSize) || classifyMisses
+            || hotBlocksK > 0 || collectSetStats || estimateCycles || nMshrs > 0 || windowLen > 0
+            || nCores > 0 || verify || collapseRuns || fuseWritePolicies)) {
+        cout << "--sample only combines with --index and --tlb\n";
+        return -1;
+    }
+    if (!tenantTraces.empty()) {
+        bool others = prefetchType != "" || writeBufferEntries > 0 || victimEntries > 0
+            || (sectorSize > 0 && sectorSize < blockSize) || classifyMisses || hotBlocksK > 0
+            || collectSetStats || estimateCycles || nMshrs > 0 || windowLen > 0 || nCores > 0 || verify
+            || collapseRuns || fuseWritePolicies || sampleUnit > 0 || tlbL1Entries > 0;
+        if (others) {
+            cout << "--tenants only combines with --index\n";
+            return -1;
+        }
+        u64 nWays = numWays == 0 ? CACHE_SIZE / blockSize : numWays;
+        u64 allWays = nWays >= 64 ? ALL_WAYS : (1ull << nWays) - 1;
+        for (u64& mask : tenantMasks) {
+            if (mask == ALL_WAYS || mask == allWays) {
+                mask = ALL_WAYS;
+                continue;
+            }
+            if (nWays > 64 || (mask & ~allWays) != 0) {
+                cout << "Way masks need at most 64 ways, and only ways of the cache\n";
+                return -1;
+            }
+            if (replacementPolicy == OPT || indexFunction == indexSkew) {
+                cout << "Way masks cannot be combined with OPT or --index skew\n";
+                return -1;
+            }
+        }
+    }
+    // The functional warm-up path skips these
+    if (warmupLen > 0 && (replacementPolicy == OPT || prefetchType != "" || writeBufferEntries > 0
+            || victimEntries > 0 || (sectorSize > 0 && sectorSize < blockSize) || classifyMisses
+            || sampleUnit > 0 || nCores > 0 || !tenantTraces.empty())) {
+        cout << "--warmup cannot be combined with OPT, --prefetch, --wbuf, --victim, --sector,\n"
+             << "--classify, --sample, --cores or --tenants\n";
+        return -1;
+    }
+    // Prefetches and buffered writes would need MSHRs of their own
+    if (nMshrs > 0 && (prefetchType != "" || writeBufferEntries > 0)) {
+        cout << "--mshr cannot be combined with --prefetch or --wbuf\n";
+        return -1;
+    }
+    if (tlbL1Entries > 0 && nCores > 0) {
+        cout << "--tlb cannot be combined with --cores\n";
+        return -1;
+    }
+    // OPT assumes lines are never invalidated, which MESI does
+    if (replacementPolicy == OPT && nCores > 0) {
+        cout << "OPT cannot be combined with --cores\n";
+        return -1;
+    }
+    // The reference model only knows the plain cache
+    if (verify && (replacementPolicy == OPT || prefetchType != "" || writeBufferEntries > 0
+            || victimEntries > 0 || nCores > 0 || indexFunction != indexBits
+            || (sectorSize > 0 && sectorSize < blockSize))) {
+        cout << "--verify supports binTree, LRU and PLRU without --prefetch, --wbuf,\n"
+             << "--victim, --cores, --index or --sector\n";
+        return -1;
+    }
     return 0;
 }
 
+/*
+    Appends a stats table to the result store, with the configuration it
+    came from, and exports it as a TSV file unless --no-tsv is given.
+    config holds the arguments that determine the results.
+*/
+void saveStats(string config, int blockSize, int numWays, ReplacementPolicy rp, WritePolicy wp,
+               string statsFile, vector<StatsColumn>& columns, vector<vector<double> >& stats) {
+    vector<string> names;
+    vector<int> precisions;
+    for (StatsColumn& col : columns) {
+        names.push_back(col.name);
+        precisions.push_back(col.precision);
+    }
+    ResultStore store("../output/results.db");
+    if (store.append(config, blockSize, numWays, replaceToS(rp), writeToS(wp), names, precisions, stats)) {
+        cout << "Appended " << stats.size() << " rows to " << store.filename << endl;
+    }
+    if (exportTsv) writeFile(statsFile, columns, stats);
+}
+
+/*
+    Multi-core mode: per trace, one row per core. Optional single-cache
+    features (--classify, --prefetch, ...) are not applied here.
+*/
+void runMultiCore(string argsJoined, string config) {
+    vector<StatsColumn> columns {
+        {"trace id", 0},
+        {"core", 0},
+        {"access count", 0},
+        {"miss rate", 1},
+        {"write mem count", 0},
+        {"read mem count", 0},
+        {"read miss", 0},
+        {"coherence miss", 0},
+        {"invalidations", 0},
+        {"c2c transfers", 0},
+        {"coherence wb", 0}
+    };
+    int threads = nThreads > 0 ? nThreads : (int) thread::hardware_concurrency();
+
+    vector<vector<double> > stats;
+    for (int i = 1; i <= 4; ++i) {
+        MultiCoreSim sim(nCores, blockSize, numWays, replacementPolicy);
+        string inFile = "../input/" + to_string(i) + ".mtrace";
+        cout << "reading file: " << inFile << endl;
+        readTaggedFile(inFile, sim);
+        sim.run(threads);
+
+        for (int c = 0; c < nCores; ++c) {
+            Cache& cache = *sim.caches[c];
+            CoreStats& cs = sim.coreStats[c];
+            string outFile = "../output/" + to_string(i) + ".core" + to_string(c) + ".log";
+            cache.outputLog(outFile);
+            stats.push_back(vector<double> {
+                (double) i,
+                (double) c,
+                (double) cache.getAccessCnt(),
+                (double) (cache.getAccessCnt() == 0 ? 0.0 : 100.0 * cache.getMissRate()),
+                (double) (cache.getWriteMemCnt() + cs.nCoherenceWb),
+                (double) cache.getReadMemCnt(),
+                (double) cache.nReadMiss,
+                (double) cs.nCoherenceMiss,
+                (double) cs.nInvalidations,
+                (double) cs.nTransfers,
+                (double) cs.nCoherenceWb
+            });
+        }
+    }
+    string statsFile = "../output/stats/stats_" + argsJoined + "_cores" + to_string(nCores) + ".tsv";
+    saveStats(config, blockSize, numWays, replacementPolicy, writePolicy, statsFile, columns, stats);
+}
+
+/*
+    Multi-tenant mode: the traces of all tenants share one cache, one row
+    per tenant. Logs go to ../output/tenant<t>.log.
+*/
+void runTenants(string argsJoined, string config) {
+    vector<StatsColumn> columns {
+        {"tenant", 0},
+        {"trace id", 0},
+        {"rate", 0},
+        {"ways", 0},
+        {"access count", 0},
+        {"miss rate", 1},
+        {"write mem count", 0},
+        {"read mem count", 0},
+        {"read miss", 0},
+        {"read mem bytes", 0},
+        {"write mem bytes", 0},
+        {"evicted by others", 0},
+        {"evictions of others", 0}
+    };
+    int nTenants = tenantTraces.size();
+    Cache* cache = new Cache(blockSize, numWays, replacementPolicy, writePolicy, indexFunction);
+    TenantSim sim(cache, tenantRates, tenantMasks);
+    for (int t = 0; t < nTenants; ++t) {
+        string inFile = "../input/" + to_string(tenantTraces[t]) + ".trace";
+        cout << "reading file: " << inFile << endl;
+        vector<Instr> instrs;
+        readFile(inFile, instrs);
+        sim.addInstrs(t, instrs);
+    }
+    sim.run();
+
+    vector<vector<double> > stats;
+    for (int t = 0; t < nTenants; ++t) {
+        TenantStats& ts = sim.stats[t];
+        Cache::writeLog("../output/tenant" + to_string(t) + ".log", sim.logs[t]);
+        u64 nWays = tenantMasks[t] == ALL_WAYS ? cache->nWays : __builtin_popcountll(tenantMasks[t]);
+        stats.push_back(vector<double> {
+            (double) t,
+            (double) tenantTraces[t],
+            (double) tenantRates[t],
+            (double) nWays,
+            (double) ts.nAccess,
+            (double) (ts.nAccess == 0 ? 0.0 : 100.0 * ts.nMiss / ts.nAccess),
+            (double) ts.nWriteMem,
+            (double) ts.nReadMem,
+            (double) ts.nReadMiss,
+            (double) ts.nReadBytes,
+            (double) ts.nWriteBytes,
+            (double) ts.nEvictedByOthers,
+            (double) ts.nEvictions
+        });
+    }
+    string statsFile = "../output/stats/stats_" + argsJoined + "_tenants" + to_string(nTenants) + ".tsv";
+    saveStats(config, blockSize, numWays, replacementPolicy, writePolicy, statsFile, columns, stats);
+}
+
+/*
+    Experiment grid, one cross product of configurations per line:
+
+        <block sizes> | <ways> | <replacement policies> | <write policies>
+
+    with the values of each field separated by spaces. A line
+    `log <block size> <ways> <replacement> <write>` picks the configuration
+    whose Hit/Miss logs go to ../output/<i>.log, by default the last one.
+    Lines starting with '#' are comments.
+*/
+struct GridConfig {
+    int blockSize;
+    int numWays;
+    ReplacementPolicy replacementPolicy;
+    WritePolicy writePolicy;
+    string name;    // "<block size> <ways> <replacement> <write>"
+};
+
+bool readGrid(string filename, vector<GridConfig>& configs, string& logName) {
+    ifstream fin(filename);
+    if (!fin.is_open()) {
+        cout << "Error opening grid file: " << filename << endl;
+        return false;
+    }
+    unordered_map<string, int> seen;
+    string line;
+    while (getline(fin, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream words(line);
+        string first;
+        if (!(words >> first)) continue;
+        if (first == "log") {
+            logName = line.substr(line.find("log") + 4);
+            continue;
+        }
+        vector<string> fields = split(line, '|');
+        if (fields.size() != 4) {
+            cout << "Invalid grid line: " << line << endl;
+            return false;
+        }
+        vector<vector<string> > values(4);
+        for (int f = 0; f < 4; ++f) {
+            istringstream in(fields[f]);
+            string v;
+            while (in >> v) values[f].push_back(v);
+        }
+        for (string& b : values[0]) for (string& w : values[1])
+        for (string& r : values[2]) for (string& wp : values[3]) {
+            GridConfig c { atoi(b.c_str()), atoi(w.c_str()),
+                           sToReplace(r.c_str()), sToWrite(wp.c_str()),
+                           resultConfig({ b, w, r, wp }) };
+            if (c.blockSize <= 0 || c.numWays < 0 || c.replacementPolicy == replaceNull
+                || c.writePolicy == writeNull) {
+                cout << "Invalid grid configuration: " << c.name << endl;
+                return false;
+            }
+            if (seen.count(c.name)) continue;
+            seen[c.name] = configs.size();
+            configs.push_back(c);
+        }
+    }
+    if (!configs.empty() && (logName.empty() || !seen.count(logName))) {
+        if (!logName.empty()) cout << "Log configuration not in grid: " << logName << endl;
+        logName = configs.back().name;
+    }
+    return true;
+}
+
+// Rough cost per access: the tag search scans the set (a hash lookup when
+// fully associative), and the bit-packed LRU order costs ways * log(ways)
+// per update, against log(ways) for the tree-based policies.
+double estimateCost(const GridConfig& c, u64 traceLen) {
+    double nBlocks = (double) (CACHE_SIZE / c.blockSize);
+    double ways = c.numWays == 0 ? nBlocks : c.numWays;
+    double bits = log2(ways) + 1;
+    double lookup = (ways == nBlocks) ? 1 : ways;
+    double replace = (c.replacementPolicy == LRU) ? ways * bits : bits;
+    return traceLen * (1 + lookup + replace);
+}
+
+/*
+    Runs every (configuration, trace) pair of the grid as a job on a
+    work-stealing pool, longest estimated jobs first. Traces are read once
+    and shared read-only. Each configuration's stats file is written, as in
+    a single run, when its last trace finishes.
+*/
+void runGrid() {
+    vector<GridConfig> configs;
+    string logName;
+    if (!readGrid(gridFile, configs, logName)) return;
+
+    vector<vector<Instr> > traces(4);
+    for (int i = 0; i < 4; ++i) {
+        string inFile = "../input/" + to_string(i + 1) + ".trace";
+        cout << "reading file: " << inFile << endl;
+        readFile(inFile, traces[i]);
+    }
+
+    int threads = nThreads > 0 ? nThreads : (int) thread::hardware_concurrency();
+    // Block IDs of every trace, once per block size used with OPT, shared
+    // read-only by the jobs
+    unordered_map<int, vector<BlockIds*> > blockIds;
+    for (const GridConfig& c : configs) {
+        if (c.replacementPolicy != OPT || blockIds.count(c.blockSize)) continue;
+        for (int i = 0; i < 4; ++i) {
+            blockIds[c.blockSize].push_back(new BlockIds(traces[i], log2u(c.blockSize), threads));
+        }
+    }
+
+    ResultCache* memo = memoResults ? new ResultCache("../output/cache") : nullptr;
+    vector<StatsColumn> columns = baseColumns();
+
+    u64 nJobs = configs.size() * 4;
+    vector<double> costs(nJobs);
+    vector<u64> order(nJobs);
+    for (u64 k = 0; k < nJobs; ++k) {
+        costs[k] = estimateCost(configs[k / 4], traces[k % 4].size());
+        order[k] = k;
+    }
+    stable_sort(order.begin(), order.end(), [&](u64 a, u64 b) { return costs[a] > costs[b]; });
+
+    vector<vector<vector<double> > > stats(configs.size(), vector<vector<double> >(4));
+    vector<int> remaining(configs.size(), 4);
+    u64 nDone = 0;
+    mutex outputLock;
+    auto t_start = chrono::high_resolution_clock::now();
+
+    auto job = [&](u64 k) {
+        const GridConfig& c = configs[k / 4];
+        int i = k % 4;
+        string inFile = "../input/" + to_string(i + 1) + ".trace";
+        string outFile = "../output/" + to_string(i + 1) + ".log";
+        bool writeLog = (c.name == logName);
+        string tmpLog = outFile + "." + to_string(k) + ".tmp";
+        string memoKey = memo ? memo->getKey(inFile, c.name) : "";
+
+        vector<double> row;
+        bool cached = memo && memo->load(memoKey, row, writeLog ? tmpLog : "");
+        if (!cached) {
+            Cache cache(c.blockSize, c.numWays, c.replacementPolicy, c.writePolicy);
+            cache.showProgress = false;
+            if (c.replacementPolicy == OPT) cache.blockIds = blockIds.at(c.blockSize)[i];
+            cache.processInstrs(traces[i]);
+            row = baseRow(i + 1, cache);
+            if (writeLog || memo) cache.outputLog(tmpLog);
+            if (memo && !traces[i].empty()) memo->store(memoKey, row, tmpLog);
+        }
+        if (writeLog) {
+            rename(tmpLog.c_str(), outFile.c_str());
+        } else if (!cached) {
+            remove(tmpLog.c_str());
+        }
+
+        lock_guard<mutex> guard(outputLock);
+        stats[k / 4][i] = row;
+        double elapsed = chrono::duration<double>(chrono::high_resolution_clock::now() - t_start).count();
+        printf("[%llu/%llu] %s trace %d%s, %.1fs elapsed\n", ++nDone, nJobs, c.name.c_str(),
+               i + 1, cached ? " (memoized)" : "", elapsed);
+        if (--remaining[k / 4] == 0) {
+            string statsFile = "../output/stats/stats_" + toFileName(c.name) + ".tsv";
+            saveStats(c.name, c.blockSize, c.numWays, c.replacementPolicy, c.writePolicy,
+                      statsFile, columns, stats[k / 4]);
+        }
+        fflush(stdout);
+    };
+
+    cout << "running " << nJobs << " jobs on " << threads << " threads\n";
+    WorkStealingPool pool(threads);
+    pool.run(order, job);
+    for (auto& it : blockIds) {
+        for (BlockIds* ids : it.second) delete ids;
+    }
+    delete memo;
+}
+
 int main(int argc, char** argv) {
     #ifdef ARG
     if (parse_args(argc, argv) == -1) {
@@ -172,6 +927,11 @@ int main(int argc, char** argv) {
     }
     #endif
 
+    if (gridFile != "") {
+        runGrid();
+        return 0;
+    }
+
     cout << "\n--- Init cache ---\n";
     cout << "Block size:            " << blockSize << endl;
     cout << "Number of ways:        " << numWays << endl;
@@ -181,19 +941,230 @@ int main(int argc, char** argv) {
     cout << "Write policy:          " << argv[4] << "\n\n";
     #endif
 
-    vector<vector<float> > stats;
+    // Configuration of this run as if the given write policy was run on
+    // its own
+    auto configOf = [&](WritePolicy policy) {
+        vector<string> args(argv + 1, argv + argc);
+        args[3] = writeToS(policy);
+        return resultConfig(args);
+    };
+
+    #ifdef ARG
+    string argsJoined = toFileName(configOf(writePolicy));
+    #else
+    string argsJoined = "test";
+    #endif
+
+    if (nCores > 0) {
+        runMultiCore(argsJoined, configOf(writePolicy));
+        return 0;
+    }
+    if (!tenantTraces.empty()) {
+        runTenants(argsJoined, configOf(writePolicy));
+        return 0;
+    }
+
+    vector<StatsColumn> columns = baseColumns();
+    if (sectorSize > 0 && sectorSize < blockSize) {
+        columns.push_back({"sector miss", 0});
+    }
+    if (tlbL1Entries > 0) {
+        columns.push_back({"tlb miss", 0});
+        columns.push_back({"page walks", 0});
+        columns.push_back({"walk mem refs", 0});
+        columns.push_back({"pages", 0});
+    }
+    if (classifyMisses) {
+        columns.push_back({"compulsory miss", 0});
+        columns.push_back({"capacity miss", 0});
+        columns.push_back({"conflict miss", 0});
+    }
+    if (prefetchType != "") {
+        columns.push_back({"prefetch count", 0});
+        columns.push_back({"prefetch useful", 0});
+        columns.push_back({"prefetch unused", 0});
+        columns.push_back({"prefetch coverage", 1});
+        columns.push_back({"prefetch accuracy", 1});
+        columns.push_back({"prefetch lead", 1});
+        columns.push_back({"pollution miss", 0});
+        columns.push_back({"prefetch write mem count", 0});
+    }
+    if (writeBufferEntries > 0) {
+        columns.push_back({"wbuf write count", 0});
+        columns.push_back({"wbuf coalesced", 0});
+        columns.push_back({"wbuf full stall", 0});
+        columns.push_back({"wbuf read hit", 0});
+    }
+    if (victimEntries > 0) {
+        columns.push_back({"victim hit", 0});
+        columns.push_back({"victim deferred wb", 0});
+        columns.push_back({"victim saved wb", 0});
+        columns.push_back({"victim write mem count", 0});
+    }
+    if (estimateCycles) {
+        columns.push_back({"amat", 2});
+        columns.push_back({"total cycles", 0});
+        columns.push_back({"bandwidth stall cycles", 0});
+    }
+    if (warmupLen > 0) {
+        columns.push_back({"warmup accesses", 0});
+    }
+    if (nMshrs > 0) {
+        columns.push_back({"mshr cycles", 0});
+        columns.push_back({"mlp", 2});
+        columns.push_back({"mshr full stall cycles", 0});
+        columns.push_back({"bus stall cycles", 0});
+        columns.push_back({"bus utilization", 1});
+        columns.push_back({"secondary miss", 0});
+    }
+    if (windowLen > 0) {
+        columns.push_back({"windows", 0});
+        columns.push_back({"phases", 0});
+    }
+    if (sampleUnit > 0) {
+        columns.push_back({"sampled units", 0});
+        columns.push_back({"detailed accesses", 0});
+        columns.push_back({"warmed accesses", 0});
+        columns.push_back({"miss rate ci", 2});
+        columns.push_back({"write mem ci", 0});
+        columns.push_back({"read mem ci", 0});
+    }
+
+    /*
+        Policies reported by this run. Write-back and write-through with the
+        same allocation keep identical tags and replacement state, so with
+        --fuse the write-back cache is simulated once and the write-through
+        row derived from it: it has no dirty bits, and sends every write to
+        memory.
+    */
+    vector<WritePolicy> policies { writePolicy };
+    if (fuseWritePolicies) {
+        WritePolicy other = toggleWriteHit(writePolicy);
+        policies = isWriteBack(writePolicy)
+            ? vector<WritePolicy> { writePolicy, other }
+            : vector<WritePolicy> { other, writePolicy };
+    }
+
+    // Results are memoized unless extra per-trace reports are requested
+    ResultCache* memo = nullptr;
+    vector<string> configs(policies.size());
+    for (int p = 0; p < (int) policies.size(); ++p) {
+        configs[p] = configOf(policies[p]);
+    }
+    if (memoResults && hotBlocksK == 0 && !collectSetStats && windowLen == 0 && !verify
+            && sampleUnit == 0 && nMshrs == 0) {
+        memo = new ResultCache("../output/cache");
+    }
+
+    vector<vector<vector<double> > > stats(policies.size());
     // loop files
     for (int i = 1; i <= 4; ++i) {
-        Cache cache(blockSize, numWays, replacementPolicy, writePolicy);
-
         string inFile = "../input/" + to_string(i) + ".trace";
         string outFile = "../output/" + to_string(i) + ".log";
+        vector<string> memoKeys(policies.size());
+        if (memo) {
+            vector<vector<double> > rows(policies.size());
+            bool cached = true;
+            for (int p = 0; p < (int) policies.size(); ++p) {
+                memoKeys[p] = memo->getKey(inFile, configs[p]);
+                cached = cached && memo->load(memoKeys[p], rows[p], outFile);
+            }
+            if (cached) {
+                cout << "using memoized result for " << inFile << endl;
+                for (int p = 0; p < (int) policies.size(); ++p) {
+                    stats[p].push_back(rows[p]);
+                }
+                continue;
+            }
+        }
+
+        Cache cache(blockSize, numWays, replacementPolicy, policies[0], indexFunction, sectorSize);
+        if (classifyMisses) {
+            cache.classifier = new MissClassifier(cache.nBlocks, cache.lenOffset);
+        }
+        if (hotBlocksK > 0) {
+            cache.hotBlocks = new HotBlockTracker(hotBlocksK, cache.lenOffset);
+        }
+        if (collectSetStats) {
+            cache.setStats = new SetStats(cache.nSets);
+        }
+        if (prefetchType != "") {
+            cache.prefetcher = makePrefetcher(prefetchType, prefetchDegree, cache.lenOffset);
+            cache.prefetcher->init(cache.nBlocks);
+        }
+        if (writeBufferEntries > 0) {
+            cache.writeBuffer = new WriteBuffer(writeBufferEntries, drainPolicy, drainInterval,
+                                               cache.blockSize);
+        }
+        if (victimEntries > 0) {
+            cache.victimCache = new VictimCache(victimEntries);
+        }
+        if (estimateCycles) {
+            cache.latency = new LatencyModel(hitLatency, missPenalty, writebackCost, bytesPerCycle);
+        }
+        if (windowLen > 0) {
+            cache.windows = new WindowStats(windowLen, adaptiveWindows);
+        }
+        if (nMshrs > 0) {
+            cache.mshrs = new MshrModel(nMshrs, hitLatency, missPenalty, bytesPerCycle);
+        }
+        if (sampleUnit > 0) {
+            cache.sampler = new IntervalSampler(sampleUnit, samplePeriod, sampleWarm);
+        }
+
         cout << "reading file: " << inFile << endl;
         vector<Instr> instrs;
         readFile(inFile, instrs);
 
-        cache.processInstrs(instrs);
-        cache.outputLog(outFile);
+        // The cache is physically indexed and tagged
+        Tlb* tlb = nullptr;
+        if (tlbL1Entries > 0) {
+            tlb = new Tlb(tlbL1Entries, tlbL2Entries, pageSize, pageAlloc,
+                          cache.nSets * cache.blockSize);
+        }
+
+        // Warm-up accesses are translated as they are used, so the TLB
+        // statistics can be reset along with the cache's
+        u64 nWarmup = 0;
+        if (warmupLen > 0) {
+            u64 maxLen = warmupUntilFull ? instrs.size() / 2 : warmupLen;
+            function<void(Instr&)> translate = nullptr;
+            if (tlb) translate = [&](Instr& instr) { instr.addr = tlb->translate(instr.addr); };
+            nWarmup = cache.warmUp(instrs, maxLen, warmupUntilFull, translate);
+            if (tlb) tlb->resetStats();
+            instrs.erase(instrs.begin(), instrs.begin() + nWarmup);
+            cout << "warmed up with " << nWarmup << " accesses" << endl;
+        }
+        if (tlb) tlb->translate(instrs);
+
+        // OPT and the classifier track blocks by dense ID
+        BlockIds* blockIds = nullptr;
+        if (replacementPolicy == OPT || cache.classifier) {
+            int threads = nThreads > 0 ? nThreads : (int) thread::hardware_concurrency();
+            blockIds = new BlockIds(instrs, cache.lenOffset, threads);
+            cache.blockIds = blockIds;
+            if (cache.classifier) cache.classifier->setBlockIds(blockIds);
+            cout << "interned " << blockIds->size() << " distinct blocks" << endl;
+        }
+
+        if (verify) {
+            Verifier verifier(cache, verifyWindow, verifyPeriod);
+            if (!verifier.run(cache, instrs)) {
+                cout << "verify failed on " << inFile << endl;
+                return 1;
+            }
+            cout << "verify: " << verifier.nChecked << " of " << instrs.size()
+                 << " accesses match the reference model" << endl;
+        } else if (collapseRuns) {
+            vector<u32> runs = Cache::encodeRuns(instrs, cache.lenOffset);
+            cout << "collapsed " << instrs.size() << " accesses into " << runs.size() << " runs" << endl;
+            cache.processRuns(instrs, runs);
+        } else {
+            cache.processInstrs(instrs);
+        }
+        delete blockIds;
+        // A sampled log would only cover the measurement units
+        if (!cache.sampler) cache.outputLog(outFile);
         // for (auto& it : cache.rm->accCnt) {
         //     cout << it.first << ": " << it.second << endl;
         // }
@@ -204,17 +1175,109 @@ int main(int argc, char** argv) {
         // printBin(cache.rm->data, 2048);
         // exit(0);
 
-        vector<float> t{
-            (float) i,
-            (float) cache.nBytes,
-            (float) cache.rm->getNBytes(),
-            (float) cache.getAccessCnt(),
-            (float) cache.getMissRate(),
-            (float) cache.getWriteMemCnt(),
-            (float) cache.getReadMemCnt(),
-            (float) cache.nReadMiss
-        };
-        stats.push_back(t);
+        vector<double> t = baseRow(i, cache);
+        if (cache.nSectors > 1) {
+            t.push_back((double) cache.nSectorMiss);
+        }
+        if (tlb) {
+            t.push_back((double) tlb->nL1Miss);
+            t.push_back((double) tlb->nWalks);
+            t.push_back((double) tlb->nWalkRefs);
+            t.push_back((double) tlb->getNPages());
+            delete tlb;
+        }
+        if (cache.classifier) {
+            t.push_back((double) cache.classifier->nCompulsoryMiss);
+            t.push_back((double) cache.classifier->nCapacityMiss);
+            t.push_back((double) cache.classifier->nConflictMiss);
+        }
+        if (cache.prefetcher) {
+            Prefetcher* pf = cache.prefetcher;
+            t.push_back((double) pf->nIssued);
+            t.push_back((double) pf->nUseful);
+            t.push_back((double) pf->nUnused);
+            t.push_back((double) (100.0 * pf->getCoverage(cache.getMissCnt())));
+            t.push_back((double) (100.0 * pf->getAccuracy()));
+            t.push_back((double) pf->getAvgLead());
+            t.push_back((double) pf->nPollution);
+            t.push_back((double) pf->nWriteback);
+        }
+        if (cache.writeBuffer) {
+            WriteBuffer* wb = cache.writeBuffer;
+            t.push_back((double) wb->nWrites);
+            t.push_back((double) wb->nCoalesced);
+            t.push_back((double) wb->nFullStalls);
+            t.push_back((double) wb->nReadHits);
+        }
+        if (cache.victimCache) {
+            VictimCache* vc = cache.victimCache;
+            t.push_back((double) vc->nHits);
+            t.push_back((double) vc->nDeferred);
+            t.push_back((double) vc->nSaved);
+            t.push_back((double) vc->nWritebacks);
+        }
+        if (cache.latency) {
+            t.push_back((double) cache.latency->getAmat());
+            t.push_back((double) cache.latency->cycles);
+            t.push_back((double) cache.latency->stallCycles);
+        }
+        if (warmupLen > 0) {
+            t.push_back((double) nWarmup);
+        }
+        if (cache.mshrs) {
+            MshrModel* mshrs = cache.mshrs;
+            t.push_back((double) mshrs->getCycles());
+            t.push_back((double) mshrs->getMlp());
+            t.push_back((double) mshrs->fullStallCycles);
+            t.push_back((double) mshrs->busStallCycles);
+            t.push_back((double) (100.0 * mshrs->getBusUtilization()));
+            t.push_back((double) mshrs->nSecondary);
+        }
+        if (cache.windows) {
+            t.push_back((double) cache.windows->size());
+            t.push_back((double) cache.windows->nPhases);
+        }
+        if (cache.sampler) {
+            IntervalSampler* sampler = cache.sampler;
+            applyEstimates(t, *sampler, instrs.size());
+            t.push_back((double) sampler->nUnits);
+            t.push_back((double) sampler->nMeasured);
+            t.push_back((double) sampler->nWarmed);
+            t.push_back((double) (100.0 * sampler->getHalfWidth(sampleMiss)));
+            t.push_back((double) (sampler->getHalfWidth(sampleWriteMem) * instrs.size()));
+            t.push_back((double) (sampler->getHalfWidth(sampleReadMem) * instrs.size()));
+        }
+        stats[0].push_back(t);
+        if (fuseWritePolicies) {
+            // Differs in cache space, write mem count and write mem bytes
+            vector<double> wt(t);
+            wt[1] = (double) cache.getNBytes(policies[1]);
+            wt[5] = (double) cache.nWrite;
+            wt[9] = (double) (cache.nWrite * (WORD_SIZE < cache.blockSize ? WORD_SIZE : cache.blockSize));
+            stats[1].push_back(wt);
+        }
+        if (memo && !instrs.empty()) {
+            for (int p = 0; p < (int) policies.size(); ++p) {
+                memo->store(memoKeys[p], stats[p].back(), outFile);
+            }
+        }
+
+        if (cache.hotBlocks) {
+            string hotFile = "../output/stats/hot_" + argsJoined + "_" + to_string(i) + ".tsv";
+            cache.hotBlocks->writeReport(hotFile);
+        }
+        if (cache.setStats) {
+            string setsFile = "../output/stats/sets_" + argsJoined + "_" + to_string(i) + ".csv";
+            cache.setStats->writeCsv(setsFile);
+        }
+        if (cache.mshrs) {
+            string mshrFile = "../output/stats/mshr_" + argsJoined + "_" + to_string(i) + ".tsv";
+            cache.mshrs->writeHistogram(mshrFile);
+        }
+        if (cache.windows) {
+            string winFile = "../output/stats/win_" + argsJoined + "_" + to_string(i) + ".bin";
+            cache.windows->writeColumns(winFile);
+        }
 
         #ifdef LOG_CACHE_STATS
         cache.printStats();
@@ -222,16 +1285,15 @@ int main(int argc, char** argv) {
         printf("Replacement space = %lluB\n", cache.rm->nBytes);
         #endif
     }
-    #ifdef ARG
-    string argsJoined(argv[1]);
-    for (int i = 2; i < argc; ++i) {
-       argsJoined += "_" + string(argv[i]);
+    for (int p = 0; p < (int) policies.size(); ++p) {
+        string statsFile = "../output/stats/stats_" + argsJoined + ".tsv";
+        #ifdef ARG
+        if (fuseWritePolicies) {
+            statsFile = "../output/stats/stats_" + toFileName(configs[p]) + ".tsv";
+        }
+        #endif
+        saveStats(configs[p], blockSize, numWays, replacementPolicy, policies[p], statsFile, columns, stats[p]);
     }
-    #else
-    string argsJoined = "test";
-    #endif
-    string statsFile = "../output/stats/stats_" + argsJoined + ".tsv";
-
-    writeFile(statsFile, stats);
+    delete memo;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <vector>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+#include "blockIds.hpp"
+
+using namespace std;
+
+/*
+    Fully-associative LRU cache of block addresses with O(1) access, used as
+    a shadow of the real cache. Recency order is a doubly-linked list over
+    flat arrays of slots, and a FlatHashMap maps blocks to their slot. With
+    dense keys (block IDs below nKeys), a flat vector replaces the map.
+*/
+const u32 LRU_NULL = ~0u;
+
+class ShadowLRU {
+public:
+    u64 capacity;
+    vector<u64> blocks;     // Block held by each slot
+    vector<u32> prev;       // Towards MRU
+    vector<u32> next;       // Towards LRU
+    u32 head = LRU_NULL;    // MRU slot
+    u32 tail = LRU_NULL;    // LRU slot
+    u32 nUsed = 0;
+    FlatHashMap<u32> slots;
+    vector<u32> denseSlots;     // Per key, with dense keys
+
+    ShadowLRU(u64 capacity)
+    :
+        capacity(capacity),
+        blocks(capacity),
+        prev(capacity, LRU_NULL),
+        next(capacity, LRU_NULL),
+        slots(capacity)
+    {}
+
+    // Returns whether block hits. On a miss the block is only inserted
+    // (evicting the LRU block) if allocate is set.
+    bool access(u64 block, bool allocate) {
+        u32* slot = findSlot(block);
+        if (slot != nullptr) {
+            moveToFront(*slot);
+            return true;
+        }
+        if (!allocate) return false;
+
+        u32 s;
+        if (nUsed < capacity) {
+            s = nUsed++;
+        } else {
+            s = tail;
+            unlink(s);
+            if (denseSlots.empty()) slots.erase(blocks[s]); else denseSlots[blocks[s]] = LRU_NULL;
+        }
+        blocks[s] = block;
+        if (denseSlots.empty()) slots.insert(block, s); else denseSlots[block] = s;
+        pushFront(s);
+        return false;
+    }
+
+    // Only before the first access
+    void useDenseKeys(u64 nKeys) {
+        assert(nUsed == 0);
+        denseSlots.assign(nKeys, LRU_NULL);
+        slots.reset(0);
+    }
+
+    u64 getNBytes() const {
+        return capacity * (sizeof(u64) + 2 * sizeof(u32)) + slots.getNBytes()
+               + denseSlots.size() * sizeof(u32);
+    }
+
+private:
+    u32* findSlot(u64 block) {
+        if (denseSlots.empty()) return slots.find(block);
+        return denseSlots[block] != LRU_NULL ? &denseSlots[block] : nullptr;
+    }
+
+    void unlink(u32 s) {
+        if (prev[s] != LRU_NULL) next[prev[s]] = next[s]; else head = next[s];
+        if (next[s] != LRU_NULL) prev[next[s]] = prev[s]; else tail = prev[s];
+    }
+
+    void pushFront(u32 s) {
+        prev[s] = LRU_NULL;
+        next[s] = head;
+        if (head != LRU_NULL) prev[head] = s;
+        head = s;
+        if (tail == LRU_NULL) tail = s;
+    }
+
+    void moveToFront(u32 s) {
+        if (head == s) return;
+        unlink(s);
+        pushFront(s);
+    }
+};
+
+
+/*
+    Three-C miss classification. Every miss of the real cache is attributed
+    to exactly one of:
+    - compulsory: first access to the block,
+    - capacity: also misses in a fully-associative LRU cache of the same
+      capacity,
+    - conflict: hits in that fully-associative cache.
+*/
+class MissClassifier {
+public:
+    u64 lenOffset;
+    FlatHashSet seen;
+    ShadowLRU shadow;
+    // With block IDs of the trace, first touches and the shadow are
+    // tracked by ID, in flat vectors
+    const BlockIds* blockIds = nullptr;
+    vector<u8> seenIds;
+    u64 nAccess = 0;
+
+    u64 nCompulsoryMiss = 0;
+    u64 nCapacityMiss = 0;
+    u64 nConflictMiss = 0;
+
+    MissClassifier(u64 nBlocks, u64 lenOffset)
+    :
+        lenOffset(lenOffset),
+        seen(nBlocks),
+        shadow(nBlocks)
+    {}
+
+    void setBlockIds(const BlockIds* ids) {
+        assert(nAccess == 0 && ids->lenOffset == lenOffset);
+        blockIds = ids;
+        seenIds.assign(ids->size(), 0);
+        seen.reset(0);
+        shadow.useDenseKeys(ids->size());
+    }
+
+    // Called on every access to the real cache, in trace order. `allocate` is false for
+    // write misses under no-write-allocate, which the shadow mirrors.
+    void onAccess(u64 addr, bool miss, bool allocate) {
+        u64 block = addr >> lenOffset;
+        bool firstTouch, shadowHit;
+        if (blockIds) {
+            u32 id = blockIds->ids[nAccess++];
+            assert(blockIds->blocks[id] == block);
+            firstTouch = !seenIds[id];
+            seenIds[id] = 1;
+            shadowHit = shadow.access(id, allocate);
+        } else {
+            firstTouch = seen.insert(block);
+            shadowHit = shadow.access(block, allocate);
+        }
+        if (!miss) return;
+
+        if (firstTouch) {
+            nCompulsoryMiss++;
+        } else if (!shadowHit) {
+            nCapacityMiss++;
+        } else {
+            nConflictMiss++;
+        }
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <cassert>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <functional>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+/*
+    Timing of a non-blocking cache with miss status holding registers.
+
+    The cache contents are still updated at once; this model only decides
+    when things happen. Accesses issue in trace order, one every
+    hitLatency cycles, without waiting for earlier misses (the trace has
+    no dependencies, so this is the parallelism available to a core that
+    never blocks). A memory read takes an MSHR until its data is back
+    missPenalty cycles after its bus transfer can start. A miss with all
+    MSHRs busy stalls issue until the earliest one frees. An access to a
+    block whose fill is still in flight is a secondary miss and merges
+    into that MSHR: the cache already reports it as a hit, but its data
+    comes with the fill. Writes to memory only occupy the bus. Every
+    transfer holds the bus for the bytes it moves / bytesPerCycle.
+
+    The histogram counts cycles by number of busy MSHRs. Achieved MLP is
+    the mean number of busy MSHRs over the cycles with at least one.
+*/
+class MshrModel {
+public:
+    u64 nMshrs;
+    u64 hitLatency;
+    u64 missPenalty;
+    double bytesPerCycle;
+
+    double now = 0;         // Issue time of the next access
+    double memFreeAt = 0;
+    double busCycles = 0;
+    double fullStallCycles = 0;     // Issue stalled on MSHRs
+    double busStallCycles = 0;      // Fills waiting for the bus
+    double lastDone = 0;            // Latest completion of anything issued
+    u64 nPrimary = 0;
+    u64 nSecondary = 0;
+    vector<double> histogram;       // Cycles with k MSHRs busy
+
+    MshrModel(u64 nMshrs, u64 hitLatency, u64 missPenalty, double bytesPerCycle)
+    :
+        nMshrs(nMshrs),
+        hitLatency(hitLatency),
+        missPenalty(missPenalty),
+        bytesPerCycle(bytesPerCycle),
+        histogram(nMshrs + 1, 0)
+    {}
+
+    void onAccess(u64 block, u8 accessInfo, u64 readBytes, u64 writeBytes) {
+        advance(now);
+        if (inFlight.find(block)) {
+            nSecondary++;
+        } else if (accessInfo & LOG_REPLACE) {
+            if (busy.size() == nMshrs) {
+                double freeAt = busy.top().first;
+                fullStallCycles += freeAt - now;
+                advance(freeAt);
+                now = freeAt;
+            }
+            double start = transfer(readBytes);
+            busStallCycles += start - now;
+            double done = start + missPenalty;
+            busy.push({ done, block });
+            inFlight.insert(block, done);
+            lastDone = max(lastDone, done);
+            nPrimary++;
+        }
+        if (accessInfo & LOG_WRITE_MEM) {
+            double occupancy = writeBytes / bytesPerCycle;
+            lastDone = max(lastDone, transfer(writeBytes) + occupancy);
+        }
+        now += hitLatency;
+        lastDone = max(lastDone, now);
+    }
+
+    // Lets every outstanding miss complete
+    void finish() {
+        advance(lastDone);
+        now = lastDone;
+    }
+
+    double getCycles() const {
+        return now;
+    }
+
+    double getMlp() const {
+        double busyCycles = 0;
+        double weighted = 0;
+        for (u64 k = 1; k <= nMshrs; ++k) {
+            busyCycles += histogram[k];
+            weighted += k * histogram[k];
+        }
+        return busyCycles > 0 ? weighted / busyCycles : 0;
+    }
+
+    double getBusUtilization() const {
+        return now > 0 ? busCycles / now : 0;
+    }
+
+    void writeHistogram(string filename) {
+        ofstream fout(filename);
+        if (!fout.is_open()) {
+            printf("Error opening output file\n");
+            assert(false);
+        }
+        fout << "busy mshrs\tcycles\n";
+        for (u64 k = 0; k <= nMshrs; ++k) {
+            fout << k << '\t' << (u64) histogram[k] << '\n';
+        }
+        cout << "Saved MSHR occupancy to " << filename << endl;
+    }
+
+private:
+    // Completion time and block of every busy MSHR
+    priority_queue<pair<double, u64>, vector<pair<double, u64> >, greater<pair<double, u64> > > busy;
+    FlatHashMap<double> inFlight;   // Block -> completion of its fill, while busy
+    double histTime = 0;            // Histogram is complete up to here
+
+    // Start of a transfer of the given size on the bus, which is then taken
+    double transfer(u64 bytes) {
+        double occupancy = bytes / bytesPerCycle;
+        double start = memFreeAt > now ? memFreeAt : now;
+        memFreeAt = start + occupancy;
+        busCycles += occupancy;
+        return start;
+    }
+
+    // Moves the histogram up to time t, freeing MSHRs that completed
+    // along with their in-flight entries
+    void advance(double t) {
+        while (!busy.empty() && busy.top().first <= t) {
+            double done = busy.top().first;
+            histogram[busy.size()] += done - histTime;
+            histTime = done;
+            inFlight.erase(busy.top().second);
+            busy.pop();
+        }
+        if (t > histTime) {
+            histogram[busy.size()] += t - histTime;
+            histTime = t;
+        }
+    }
+};
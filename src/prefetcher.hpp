@@ -0,0 +1,218 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+/*
+    Hardware prefetcher models. A prefetcher observes the demand access
+    stream (as block addresses) and proposes blocks to prefetch; the cache
+    issues the fills and keeps the bookkeeping below up to date.
+
+    Statistics:
+    - issued:    prefetch fills, i.e. extra memory reads
+    - useful:    prefetched lines that got a demand hit before eviction
+    - unused:    prefetched lines evicted without a demand hit
+    - pollution: demand misses on blocks that a prefetch fill evicted
+    - lead:      accesses between a prefetch fill and its first use
+*/
+class Prefetcher {
+public:
+    u64 degree;
+
+    // Per cache line, indexed by index * nWays + wayIndex
+    vector<u8> isPrefetched;
+    vector<u64> fillTime;
+
+    // Blocks evicted by prefetch fills, to detect pollution misses
+    FlatHashMap<u8> evictedByPrefetch;
+    u64 maxEvicted;
+
+    u64 nIssued = 0;
+    u64 nUseful = 0;
+    u64 nUnused = 0;
+    u64 nPollution = 0;
+    u64 nWriteback = 0;
+    u64 totalLead = 0;
+
+    virtual ~Prefetcher() {}
+
+    void init(u64 nLines) {
+        isPrefetched.assign(nLines, 0);
+        fillTime.assign(nLines, 0);
+        maxEvicted = 4 * nLines;
+        evictedByPrefetch.reset(nLines);
+    }
+
+    // Appends blocks to prefetch after a demand access to block. `trigger`
+    // is set on demand misses and on first hits to prefetched lines.
+    virtual void onAccess(u64 block, bool trigger, vector<u64>& out) = 0;
+
+    void onDemandHit(u64 line, u64 now) {
+        if (isPrefetched[line]) {
+            nUseful++;
+            totalLead += now - fillTime[line];
+            isPrefetched[line] = 0;
+        }
+    }
+
+    void onDemandMiss(u64 block) {
+        if (evictedByPrefetch.erase(block)) {
+            nPollution++;
+        }
+    }
+
+    // Called whenever a line is (re)filled
+    void onFill(u64 line, bool prefetch, u64 now) {
+        if (isPrefetched[line]) nUnused++;
+        isPrefetched[line] = prefetch;
+        fillTime[line] = now;
+    }
+
+    void onPrefetchEvict(u64 block) {
+        // Bound memory: forget old candidates rather than grow forever
+        if (evictedByPrefetch.size() >= maxEvicted) evictedByPrefetch.clear();
+        evictedByPrefetch.insert(block, 1);
+    }
+
+    double getAccuracy() const {
+        return nIssued == 0 ? 0.0 : (double) nUseful / nIssued;
+    }
+
+    double getCoverage(u64 nDemandMiss) const {
+        u64 total = nUseful + nDemandMiss;
+        return total == 0 ? 0.0 : (double) nUseful / total;
+    }
+
+    double getAvgLead() const {
+        return nUseful == 0 ? 0.0 : (double) totalLead / nUseful;
+    }
+
+protected:
+    Prefetcher(u64 degree) : degree(degree) {}
+};
+
+
+/*
+    Next-N-line: on a trigger, prefetch the following `degree` blocks.
+*/
+class PFNextLine : public Prefetcher {
+public:
+    PFNextLine(u64 degree) : Prefetcher(degree) {}
+
+    void onAccess(u64 block, bool trigger, vector<u64>& out) {
+        if (!trigger) return;
+        for (u64 i = 1; i <= degree; ++i) {
+            out.push_back(block + i);
+        }
+    }
+};
+
+
+/*
+    Address-delta stride detection. Without PCs, accesses are grouped by
+    4KB region; each region entry remembers its last block and delta, and
+    prefetches along the delta once it has been seen twice in a row.
+*/
+class PFStride : public Prefetcher {
+public:
+    static const int N_ENTRIES = 64;
+    static const int REGION_BITS = 12;
+
+    struct Entry {
+        u64 region = EMPTY_KEY;
+        u64 lastBlock = 0;
+        i64 delta = 0;
+        int confidence = 0;
+    };
+    u64 lenOffset;
+    Entry table[N_ENTRIES];
+
+    PFStride(u64 degree, u64 lenOffset) : Prefetcher(degree), lenOffset(lenOffset) {}
+
+    void onAccess(u64 block, bool trigger, vector<u64>& out) {
+        u64 region = (block << lenOffset) >> REGION_BITS;
+        Entry& e = table[hashU64(region) % N_ENTRIES];
+        if (e.region != region) {
+            e.region = region;
+            e.lastBlock = block;
+            e.delta = 0;
+            e.confidence = 0;
+            return;
+        }
+        i64 delta = (i64) (block - e.lastBlock);
+        if (delta == 0) return;
+        if (delta == e.delta) {
+            if (e.confidence < 3) e.confidence++;
+        } else {
+            e.delta = delta;
+            e.confidence = 0;
+        }
+        e.lastBlock = block;
+        if (e.confidence >= 1) {
+            for (u64 i = 1; i <= degree; ++i) {
+                out.push_back(block + (u64) (e.delta * (i64) i));
+            }
+        }
+    }
+};
+
+
+/*
+    Multi-stream detector. Up to N_STREAMS ascending or descending streams
+    are tracked; a miss within WINDOW blocks ahead of a stream's head
+    confirms it and prefetches `degree` blocks past the new head. Misses
+    matching no stream allocate the least recently used tracker.
+*/
+class PFStream : public Prefetcher {
+public:
+    static const int N_STREAMS = 16;
+    static const i64 WINDOW = 16;
+
+    struct Stream {
+        u64 head = 0;
+        i64 dir = 0;        // +1, -1, or 0 when not yet trained
+        bool valid = false;
+        u64 lastUse = 0;
+    };
+    Stream streams[N_STREAMS];
+    u64 time = 0;
+
+    PFStream(u64 degree) : Prefetcher(degree) {}
+
+    void onAccess(u64 block, bool trigger, vector<u64>& out) {
+        if (!trigger) return;
+        time++;
+        int lru = 0;
+        for (int i = 0; i < N_STREAMS; ++i) {
+            Stream& s = streams[i];
+            if (!s.valid) {
+                lru = i;
+                continue;
+            }
+            i64 dist = (i64) (block - s.head);
+            bool inWindow = s.dir == 0
+                ? (dist != 0 && dist >= -WINDOW && dist <= WINDOW)
+                : (dist * s.dir > 0 && dist * s.dir <= WINDOW);
+            if (inWindow) {
+                if (s.dir == 0) s.dir = dist > 0 ? 1 : -1;
+                s.head = block;
+                s.lastUse = time;
+                for (u64 k = 1; k <= degree; ++k) {
+                    out.push_back(block + (u64) (s.dir * (i64) k));
+                }
+                return;
+            }
+            if (streams[lru].valid && s.lastUse < streams[lru].lastUse) lru = i;
+        }
+        Stream& s = streams[lru];
+        s.head = block;
+        s.dir = 0;
+        s.valid = true;
+        s.lastUse = time;
+    }
+};
@@ -1,10 +1,22 @@
 #pragma once
 
+#include <vector>
+#include <algorithm>
+
 #include "global.hpp"
 #include "utils.hpp"
+#include "instr.hpp"
+#include "flatHash.hpp"
+#include "blockIds.hpp"
 
 using namespace std;
 
+// Whether any of the ways [lo, lo + size) is set in wayMask
+inline bool hasWayIn(u64 wayMask, u64 lo, u64 size) {
+    u64 bits = wayMask >> lo;
+    return size >= 64 ? bits != 0 : (bits & ((1ull << size) - 1)) != 0;
+}
+
 
 class ReplacementManager {
 public:
@@ -18,8 +30,30 @@ public:
     virtual void onReplace(u64 index, u64 wayIndex) = 0;
     virtual int getReplacement(u64 index) = 0;
     virtual void onSetFilled(u64 index) = 0;
+
+    // Victim among the ways set in wayMask, all of them valid, for way
+    // partitioning. Only sets of up to 64 ways can be partitioned.
+    virtual int getMaskedReplacement(u64 index, u64 wayMask) {
+        printf("Way partitioning is not supported by this replacement policy\n");
+        assert(false);
+        return -1;
+    }
     virtual int getNBytes() = 0;
 
+    // Hooks for offline policies that need to see the whole trace (OPT).
+    // Called once before processing, and before every access respectively.
+    // blockIds, when not null, holds the dense block IDs of instrs.
+    virtual void onTrace(const vector<Instr>& instrs, u64 lenOffset, const BlockIds* blockIds) {}
+    virtual void onInstr(u64 instrIndex) {}
+
+    // Another count accesses to the way that was just accessed. A no-op
+    // for policies where repeating onAccess changes nothing.
+    virtual void onRepeat(u64 index, u64 wayIndex, u64 count) {}
+
+    // Replacement state of a set in a policy-specific but layout-free form,
+    // compared against the reference engine by --verify
+    virtual vector<u64> getSetState(u64 index) { return vector<u64>(); }
+
     virtual ~ReplacementManager() {}
 protected:
     ReplacementManager() : data(nullptr), nBytes(0) {}
@@ -89,6 +123,16 @@ public:
 
     void onReplace(u64 index, u64 wayIndex) {}
 
+    // Bit 0 is the filled flag, bits 1.. the tree nodes
+    vector<u64> getSetState(u64 index) {
+        vector<u64> state;
+        if (nWays == 1) return state;
+        for (u64 j = 0; j < nWays; ++j) {
+            state.push_back(getBit(data, index * nWays + j));
+        }
+        return state;
+    }
+
     int getReplacement(u64 index) {
         if (nWays == 1) {
             return 0;
@@ -121,6 +165,29 @@ public:
         }
     }
 
+    // Walks towards the older half as usual, unless it has no way of the mask
+    int getMaskedReplacement(u64 index, u64 wayMask) {
+        if (nWays == 1) return 0;
+        u64 baseIdx = index * nWays;
+        u64 lo = 0;
+        u64 size = nWays;
+        u64 idx = 1;
+        while (size > 1) {
+            size /= 2;
+            bool upper = getBit(data, baseIdx + idx) == 1;
+            if (!hasWayIn(wayMask, upper ? lo + size : lo, size)) {
+                upper = !upper;
+            }
+            if (upper) {
+                lo += size;
+                idx = 2 * idx + 1;
+            } else {
+                idx = 2 * idx;
+            }
+        }
+        return (int) lo;
+    }
+
     void onSetFilled(u64 index) {
         if (nWays == 1) return;
         // cout << "on set filled " << index << endl;
@@ -214,6 +281,17 @@ public:
     }
     void onReplace(u64 index, u64 wayIndex) {}
 
+    // Ways from least to most recently used
+    vector<u64> getSetState(u64 index) {
+        vector<u64> state;
+        if (nWays == 1) return state;
+        u8* set = data + bytesPerSet * index;
+        for (u64 idx = 0; idx < nWays; ++idx) {
+            state.push_back(at(set, idx));
+        }
+        return state;
+    }
+
     int getReplacement(u64 index) {
         // Returns signed int because other replacement methods might 
         // return -1 to delegate lookup of invalid lines to cache.
@@ -222,11 +300,62 @@ public:
         return (int) at(set, 0);
     }
 
+    int getMaskedReplacement(u64 index, u64 wayMask) {
+        u8* set = data + bytesPerSet * index;
+        for (u64 idx = 0; idx < nWays; ++idx) {
+            u64 way = nWays == 1 ? 0 : at(set, idx);
+            if (wayMask >> way & 1) return (int) way;
+        }
+        assert(false);
+        return -1;
+    }
+
     void onSetFilled(u64 index) {
         // Pass
     }
 };
 
+/*
+    LRU for skewed-associative caches, where the lines a block may replace
+    lie in a different set in every way, so there is no per-set order to
+    keep. Each line holds the time of its last access instead, and the
+    cache picks the oldest of the candidate lines (see Cache::getReplacement).
+*/
+class RMSkewLRU : public ReplacementManager {
+public:
+    u64 nWays;
+    u64 nSets;
+    vector<u32> stamps;
+    u32 clock = 0;
+
+    RMSkewLRU(u64 nWays, u64 nSets)
+    :
+        nWays(nWays),
+        nSets(nSets),
+        stamps(nWays * nSets, 0),
+        ReplacementManager()
+    {
+        nBytes = stamps.size() * sizeof(u32);
+    }
+
+    int getNBytes() { return nBytes; }
+
+    u32 getStamp(u64 index, u64 wayIndex) const {
+        return stamps[index * nWays + wayIndex];
+    }
+
+    void onAccess(u64 index, u64 wayIndex) {
+        stamps[index * nWays + wayIndex] = ++clock;
+    }
+
+    void onReplace(u64 index, u64 wayIndex) {}
+
+    // Not used, the candidates span several sets
+    int getReplacement(u64 index) { return 0; }
+
+    void onSetFilled(u64 index) {}
+};
+
 class RMPLRU : public ReplacementManager {
 public:
     u8* counters;
@@ -266,7 +395,7 @@ public:
         // init counters
         protectCnt = nWays / 4;
         totalCounterBytes = (bitsPerCounter * nLines + 7) / 8;
-        counters = new u8[totalCounterBytes];
+        counters = new u8[totalCounterBytes]();
 
         #ifdef DEBUG
         cout << "--- LRU cache ---\n";
@@ -364,6 +493,29 @@ public:
         clearCounter(bitIdx);
     }
 
+    // Counters wrap around, like count increments would
+    void onRepeat(u64 index, u64 wayIndex, u64 count) {
+        u64 bitIdx = getCounterBitIdx(index, wayIndex);
+        u64 val = getBits(counters, bitIdx, bitsPerCounter) + count;
+        for (int i = 0; i < bitsPerCounter; ++i) {
+            setBit(counters, bitIdx + i, (val >> i) & 1);
+        }
+    }
+
+    // Ways from least to most recently used, then the counter of each way
+    vector<u64> getSetState(u64 index) {
+        vector<u64> state;
+        if (nWays == 1) return state;
+        u8* set = data + bytesPerSet * index;
+        for (u64 idx = 0; idx < nWays; ++idx) {
+            state.push_back(at(set, idx));
+        }
+        for (u64 w = 0; w < nWays; ++w) {
+            state.push_back(getCounter(index, w));
+        }
+        return state;
+    }
+
     int getReplacement(u64 index) {
         // Returns signed int because other replacement methods might 
         // return -1 to delegate lookup of invalid lines to cache.
@@ -404,5 +556,159 @@ public:
         return -2;
     }
 
+    // As getReplacement(), with counters and protection among the ways
+    // of the mask only
+    int getMaskedReplacement(u64 index, u64 wayMask) {
+        vector<u64> cnts;
+        for (u64 w = 0; w < nWays; ++w) {
+            if (wayMask >> w & 1) cnts.push_back(getCounter(index, w));
+        }
+        sort(cnts.begin(), cnts.end());
+        u64 maxCnt = cnts[cnts.size() - 1 - cnts.size() / 4];
+        u8* set = data + bytesPerSet * index;
+        for (u64 i = 0; i < nWays; ++i) {
+            u64 idx = at(set, i);
+            if ((wayMask >> idx & 1) && getCounter(index, idx) <= maxCnt) {
+                return (int) idx;
+            }
+        }
+        assert(false);
+        return -2;
+    }
+
     void onSetFilled(u64 index) {}
-};
\ No newline at end of file
+};
+
+
+/*
+    Belady's optimal (OPT) replacement, used as an offline upper bound.
+
+    Next-use times of every access are precomputed in one reverse pass over
+    the trace. Each set keeps an indexed max-heap of its ways keyed by the
+    next use of the block they hold, so the victim (farthest next use) is
+    at the root and updates are O(log ways).
+*/
+const u64 OPT_NEVER = ~0ull;
+const u32 OPT_NOT_IN_HEAP = ~0u;
+
+class RMOPT : public ReplacementManager {
+public:
+    u64 nWays;
+    u64 nSets;
+    u64 nLines;
+
+    vector<u64> nextUse;    // Per access: index of next access to the same block
+    u64 now = 0;
+
+    // Flat per-set arrays, set i occupies [i * nWays, (i + 1) * nWays)
+    vector<u64> keys;       // Next use of the block in each way
+    vector<u32> heap;       // Heap of way indices
+    vector<u32> pos;        // Position of each way in heap
+    vector<u32> heapSize;   // Number of valid ways in each set
+
+    RMOPT(u64 nWays, u64 nSets)
+    :
+        nWays(nWays),
+        nSets(nSets),
+        ReplacementManager()
+    {
+        nLines = nWays * nSets;
+        keys.assign(nLines, OPT_NEVER);
+        heap.assign(nLines, 0);
+        pos.assign(nLines, OPT_NOT_IN_HEAP);
+        heapSize.assign(nSets, 0);
+        nBytes = nLines * (sizeof(u64) + 2 * sizeof(u32)) + nSets * sizeof(u32);
+    }
+
+    int getNBytes() { return nBytes; }
+
+    void onTrace(const vector<Instr>& instrs, u64 lenOffset, const BlockIds* blockIds) {
+        u64 n = instrs.size();
+        nextUse.assign(n, OPT_NEVER);
+        if (blockIds) {
+            assert(blockIds->ids.size() == n && blockIds->lenOffset == lenOffset);
+            vector<u64> lastSeen(blockIds->size(), OPT_NEVER);
+            for (u64 i = n; i-- > 0; ) {
+                u64& last = lastSeen[blockIds->ids[i]];
+                nextUse[i] = last;
+                last = i;
+            }
+            return;
+        }
+        FlatHashMap<u64> lastSeen(n / 4);
+        for (u64 i = n; i-- > 0; ) {
+            u64 block = instrs[i].addr >> lenOffset;
+            u64& last = lastSeen.findOrInsert(block, OPT_NEVER);
+            nextUse[i] = last;
+            last = i;
+        }
+    }
+
+    void onInstr(u64 instrIndex) {
+        now = instrIndex;
+    }
+
+    void onAccess(u64 index, u64 wayIndex) {
+        assert(now < nextUse.size());
+        u64 base = index * nWays;
+        keys[base + wayIndex] = nextUse[now];
+        u32 p = pos[base + wayIndex];
+        if (p == OPT_NOT_IN_HEAP) {
+            p = heapSize[index]++;
+            heap[base + p] = (u32) wayIndex;
+            pos[base + wayIndex] = p;
+        }
+        siftUp(index, p);
+        siftDown(index, pos[base + wayIndex]);
+    }
+
+    void onReplace(u64 index, u64 wayIndex) {}
+
+    int getReplacement(u64 index) {
+        // Lines are never invalidated, so the cache fills ways in order and
+        // the first invalid way is the one after the last heap entry. This
+        // avoids the -1 protocol, which read() would pass on to onAccess().
+        if (heapSize[index] < nWays) return (int) heapSize[index];
+        return (int) heap[index * nWays];
+    }
+
+    void onSetFilled(u64 index) {}
+
+private:
+    u64 keyAt(u64 index, u32 p) {
+        u64 base = index * nWays;
+        return keys[base + heap[base + p]];
+    }
+
+    void swapAt(u64 index, u32 a, u32 b) {
+        u64 base = index * nWays;
+        u32 t = heap[base + a];
+        heap[base + a] = heap[base + b];
+        heap[base + b] = t;
+        pos[base + heap[base + a]] = a;
+        pos[base + heap[base + b]] = b;
+    }
+
+    void siftUp(u64 index, u32 p) {
+        while (p > 0) {
+            u32 parent = (p - 1) / 2;
+            if (keyAt(index, parent) >= keyAt(index, p)) break;
+            swapAt(index, p, parent);
+            p = parent;
+        }
+    }
+
+    void siftDown(u64 index, u32 p) {
+        u32 size = heapSize[index];
+        while (true) {
+            u32 largest = p;
+            u32 l = 2 * p + 1;
+            u32 r = l + 1;
+            if (l < size && keyAt(index, l) > keyAt(index, largest)) largest = l;
+            if (r < size && keyAt(index, r) > keyAt(index, largest)) largest = r;
+            if (largest == p) break;
+            swapAt(index, p, largest);
+            p = largest;
+        }
+    }
+};
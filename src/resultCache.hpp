@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+const u64 MEMO_KEEP_BINARIES = 4;  // Memo directories kept, this binary's included
+
+/*
+    On-disk memo of simulation results, so repeated sweeps skip grid points
+    whose inputs did not change.
+
+    An entry is keyed by a hash of the trace content, the full cache
+    configuration (all command line arguments) and CACHE_SIZE, and holds
+    the stats row and the Hit/Miss log of one trace. Entries live in a
+    directory named after a hash of the simulator binary itself. Each run
+    touches its directory, and only the MEMO_KEEP_BINARIES most recently
+    used ones are kept, so a few builds used side by side (a checkout and
+    a baseline binary, say) do not wipe each other's results.
+*/
+class ResultCache {
+public:
+    string root;
+    string dir;
+
+    ResultCache(string root) : root(root) {
+        mkdir(root.c_str(), 0755);
+        dir = root + "/" + toHex(hashFile("/proc/self/exe", 0));
+        mkdir(dir.c_str(), 0755);
+        utime(dir.c_str(), nullptr);
+        removeStale();
+    }
+
+    string getKey(string traceFile, string config) {
+        u64 h = hashFile(traceFile, CACHE_SIZE);
+        for (char ch : config) {
+            h = hashU64(h ^ (u8) ch);
+        }
+        return toHex(h);
+    }
+
+    // An empty logFile loads the stats row only
+    bool load(string key, vector<double>& row, string logFile) {
+        ifstream fin(dir + "/" + key + ".row");
+        if (!fin.is_open()) return false;
+        row.clear();
+        double val;
+        while (fin >> val) {
+            row.push_back(val);
+        }
+        if (logFile.empty()) return !row.empty();
+        return !row.empty() && copyFile(dir + "/" + key + ".log", logFile);
+    }
+
+    void store(string key, const vector<double>& row, string logFile) {
+        // Write to temporary files and rename, so concurrent runs never
+        // see partial entries. The log is moved in before the row, which
+        // marks the entry as complete.
+        string tmp = dir + "/" + key + "." + to_string(getpid());
+        if (!copyFile(logFile, tmp + ".log")) return;
+        rename((tmp + ".log").c_str(), (dir + "/" + key + ".log").c_str());
+        {
+            ofstream fout(tmp + ".row");
+            char buf[64];
+            for (double val : row) {
+                snprintf(buf, sizeof(buf), "%.17g\n", val);
+                fout << buf;
+            }
+        }
+        rename((tmp + ".row").c_str(), (dir + "/" + key + ".row").c_str());
+    }
+
+    static u64 hashFile(string filename, u64 seed) {
+        ifstream fin(filename, ios::binary);
+        u64 h = hashU64(seed);
+        char buf[1 << 16];
+        while (fin) {
+            fin.read(buf, sizeof(buf));
+            streamsize n = fin.gcount();
+            for (streamsize i = 0; i < n; i += 8) {
+                u64 word = 0;
+                for (streamsize j = i; j < i + 8 && j < n; ++j) {
+                    word = (word << 8) | (u8) buf[j];
+                }
+                h = hashU64(h ^ word);
+            }
+        }
+        return h;
+    }
+
+private:
+    static string toHex(u64 h) {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", h);
+        return buf;
+    }
+
+    static bool copyFile(string from, string to) {
+        ifstream fin(from, ios::binary);
+        if (!fin.is_open()) return false;
+        ofstream fout(to, ios::binary);
+        fout << fin.rdbuf();
+        return fout.good();
+    }
+
+    static void removeDir(string path) {
+        DIR* d = opendir(path.c_str());
+        if (d == nullptr) return;
+        while (dirent* ent = readdir(d)) {
+            string name = ent->d_name;
+            if (name == "." || name == "..") continue;
+            unlink((path + "/" + name).c_str());
+        }
+        closedir(d);
+        rmdir(path.c_str());
+    }
+
+    // Removes the directories of other binaries beyond the most recently
+    // used MEMO_KEEP_BINARIES
+    void removeStale() {
+        DIR* d = opendir(root.c_str());
+        if (d == nullptr) return;
+        vector<pair<time_t, string> > others;
+        while (dirent* ent = readdir(d)) {
+            string name = ent->d_name;
+            if (name == "." || name == "..") continue;
+            string path = root + "/" + name;
+            struct stat st;
+            if (path == dir || stat(path.c_str(), &st) != 0) continue;
+            others.push_back({ st.st_mtime, path });
+        }
+        closedir(d);
+        if (others.size() < MEMO_KEEP_BINARIES) return;
+        sort(others.begin(), others.end(), greater<pair<time_t, string> >());
+        for (u64 i = MEMO_KEEP_BINARIES - 1; i < others.size(); ++i) {
+            cout << "Removing stale results: " << others[i].second << endl;
+            removeDir(others[i].second);
+        }
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "global.hpp"
+
+using namespace std;
+
+const char RESULT_MAGIC[8] = { 'C', 'S', 'R', 'S', 'L', 'T', '1', '\0' };
+
+/*
+    Append-only columnar file holding the stats of every run, read by
+    query.py.
+
+    The file is a sequence of segments, one per stats table (a
+    configuration and its rows). Segments are self-describing, so runs
+    with different optional columns share the file. Layout, little endian:
+        8 bytes   magic "CSRSLT1\0"
+        u64       segment size in bytes, this header included
+        i64       unix time of the append
+        u32       number of columns
+        u64       number of rows
+        per column: name terminated by '\0', type char ('L' = i64,
+                    'D' = f64, 'S' = strings terminated by '\0')
+        per column: all values of the column, contiguous
+
+    A segment is built in memory and appended with a single write() on a
+    descriptor opened with O_APPEND, which the kernel applies atomically
+    to regular files. Concurrent runs and grid threads therefore append
+    without locks and never interleave; a reader stops at a truncated last
+    segment.
+*/
+class ResultStore {
+public:
+    string filename;
+
+    ResultStore(string filename) : filename(filename) {}
+
+    /*
+        The configuration columns (config, block size, assoc, replace and
+        write policy) are put first; stats columns with no decimals become
+        i64 columns, the others f64.
+    */
+    bool append(string config, int blockSize, int assoc, string replace, string write,
+                const vector<string>& names, const vector<int>& precisions,
+                const vector<vector<double> >& rows) {
+        u64 nRows = rows.size();
+        u32 nCols = 5 + names.size();
+        string buf(RESULT_MAGIC, sizeof(RESULT_MAGIC));
+        put(buf, (u64) 0);     // Size, filled in below
+        put(buf, (i64) time(nullptr));
+        put(buf, nCols);
+        put(buf, nRows);
+
+        const char* configNames[] = { "config", "block size", "assoc", "replace policy", "write policy" };
+        const char configTypes[] = { 'S', 'L', 'L', 'S', 'S' };
+        for (int c = 0; c < 5; ++c) {
+            buf.append(configNames[c], strlen(configNames[c]) + 1);
+            buf += configTypes[c];
+        }
+        for (u32 c = 0; c < names.size(); ++c) {
+            buf.append(names[c].c_str(), names[c].size() + 1);
+            buf += precisions[c] == 0 ? 'L' : 'D';
+        }
+
+        for (u64 r = 0; r < nRows; ++r) buf.append(config.c_str(), config.size() + 1);
+        for (u64 r = 0; r < nRows; ++r) put(buf, (i64) blockSize);
+        for (u64 r = 0; r < nRows; ++r) put(buf, (i64) assoc);
+        for (const string& str : { replace, write }) {
+            for (u64 r = 0; r < nRows; ++r) buf.append(str.c_str(), str.size() + 1);
+        }
+        for (u32 c = 0; c < names.size(); ++c) {
+            for (u64 r = 0; r < nRows; ++r) {
+                if (precisions[c] == 0) {
+                    put(buf, (i64) llround(rows[r][c]));
+                } else {
+                    put(buf, rows[r][c]);
+                }
+            }
+        }
+        u64 size = buf.size();
+        memcpy(&buf[sizeof(RESULT_MAGIC)], &size, sizeof(size));
+
+        int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) {
+            printf("Error opening result store %s\n", filename.c_str());
+            return false;
+        }
+        ssize_t written = ::write(fd, buf.data(), size);
+        close(fd);
+        if (written != (ssize_t) size) {
+            printf("Error appending to result store %s\n", filename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    template<class T>
+    static void put(string& buf, T val) {
+        buf.append((const char*) &val, sizeof(val));
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cmath>
+#include <cassert>
+
+#include "global.hpp"
+
+using namespace std;
+
+/*
+    Interval (time) sampling in the style of SMARTS.
+
+    The trace is cut into periods of `period` accesses. The last unitLen
+    accesses of every period are the measurement unit, simulated in
+    detail. The warmLen accesses before it only warm the cache
+    functionally (tags, dirty bits and replacement state, nothing
+    counted), and the rest of the period is skipped. warmLen ==
+    period - unitLen warms over the whole gap and keeps the cache state
+    exact; shorter warming trades state accuracy for speed.
+
+    Each unit gives one observation per metric, as a count per access.
+    Whole-trace values are the mean over units times the trace length,
+    with a confidence interval of SAMPLE_Z standard errors.
+*/
+enum SampledMetric {
+    sampleMiss,
+    sampleWriteMem,
+    sampleReadMem,
+    sampleReadMiss,
+    sampleReadBytes,
+    sampleWriteBytes,
+    N_SAMPLED_METRICS
+};
+
+const double SAMPLE_Z = 1.96;   // 95% confidence
+
+class IntervalSampler {
+public:
+    u64 unitLen;
+    u64 period;
+    u64 warmLen;
+
+    u64 nUnits = 0;
+    u64 nMeasured = 0;      // Accesses simulated in detail
+    u64 nWarmed = 0;        // Accesses simulated functionally
+
+    IntervalSampler(u64 unitLen, u64 period, u64 warmLen)
+    :
+        unitLen(unitLen),
+        period(period),
+        warmLen(warmLen)
+    {
+        assert(unitLen > 0 && unitLen + warmLen <= period);
+        for (int m = 0; m < N_SAMPLED_METRICS; ++m) {
+            sums[m] = sumSquares[m] = 0;
+        }
+    }
+
+    // counts holds the increase of every metric over a unit of len accesses
+    void addUnit(const u64* counts, u64 len) {
+        nUnits++;
+        nMeasured += len;
+        for (int m = 0; m < N_SAMPLED_METRICS; ++m) {
+            double x = (double) counts[m] / len;
+            sums[m] += x;
+            sumSquares[m] += x * x;
+        }
+    }
+
+    // Per access
+    double getMean(int metric) const {
+        return nUnits > 0 ? sums[metric] / nUnits : 0;
+    }
+
+    // Half width of the confidence interval of getMean(), 0 with one unit
+    double getHalfWidth(int metric) const {
+        if (nUnits < 2) return 0;
+        double mean = getMean(metric);
+        double var = (sumSquares[metric] - nUnits * mean * mean) / (nUnits - 1);
+        return SAMPLE_Z * sqrt(var > 0 ? var / nUnits : 0);
+    }
+
+private:
+    double sums[N_SAMPLED_METRICS];
+    double sumSquares[N_SAMPLED_METRICS];
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <fstream>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+/*
+    Per-set pressure statistics, stored as flat arrays indexed by set and
+    updated without branches so it is cheap enough to leave on in sweeps.
+
+    Tag diversity (distinct tags mapped to a set) is estimated by linear
+    counting over a 64-bit bitmap per set, instead of a hash set per set.
+*/
+class SetStats {
+public:
+    u64 nSets;
+    vector<u64> accesses;
+    vector<u32> misses;
+    vector<u32> evictions;
+    vector<u32> dirtyEvictions;
+    vector<u64> tagBitmaps;
+
+    SetStats(u64 nSets)
+    :
+        nSets(nSets),
+        accesses(nSets, 0),
+        misses(nSets, 0),
+        evictions(nSets, 0),
+        dirtyEvictions(nSets, 0),
+        tagBitmaps(nSets, 0)
+    {}
+
+    void onAccess(u64 index, u64 tag, bool miss) {
+        accesses[index]++;
+        misses[index] += miss;
+        tagBitmaps[index] |= 1ull << (hashU64(tag) & 63);
+    }
+
+    void onReplace(u64 index, bool evicted, bool dirty) {
+        evictions[index] += evicted;
+        dirtyEvictions[index] += dirty;
+    }
+
+    // Linear counting estimate of distinct tags, saturates around 64 * ln(64)
+    double getTagDiversity(u64 index) const {
+        int zeros = 64 - __builtin_popcountll(tagBitmaps[index]);
+        if (zeros == 0) zeros = 1;
+        return -64.0 * log(zeros / 64.0);
+    }
+
+    void writeCsv(string filename) {
+        ofstream fout(filename);
+        if (!fout.is_open()) {
+            printf("Error opening output file\n");
+            assert(false);
+        }
+        fout << "set,accesses,misses,evictions,dirty evictions,tag diversity\n";
+        for (u64 i = 0; i < nSets; ++i) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%llu,%llu,%u,%u,%u,%.1f\n",
+                     i, accesses[i], misses[i], evictions[i],
+                     dirtyEvictions[i], getTagDiversity(i));
+            fout << buf;
+        }
+        cout << "Saved set stats to " << filename << endl;
+    }
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+
+#include "global.hpp"
+#include "instr.hpp"
+#include "flatHash.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+const int MAX_TENANTS = 16;
+// Tenant ids are put above the trace addresses, so tenants never share
+// blocks even when their traces use the same addresses
+const u64 TENANT_SHIFT = 56;
+
+struct TenantStats {
+    u64 nAccess = 0;
+    u64 nMiss = 0;
+    u64 nReadMiss = 0;
+    u64 nWriteMem = 0;
+    u64 nReadMem = 0;
+    u64 nReadBytes = 0;
+    u64 nWriteBytes = 0;
+    u64 nEvictedByOthers = 0;   // Lines of this tenant replaced by another's misses
+    u64 nEvictions = 0;         // Lines of other tenants this tenant replaced
+};
+
+/*
+    Several traces sharing one cache, as co-located services share an LLC.
+
+    The traces are interleaved by smooth weighted round robin: every turn
+    each tenant with accesses left gains its rate in credit, and the one
+    with most credit issues its next access and pays the total rate. With
+    equal rates that is plain round robin; otherwise each tenant's share
+    of accesses is its share of the rates, evenly spread.
+
+    Each tenant may have a way mask, as with Intel CAT: its accesses hit
+    in any way, but its misses only fill ways of the mask, with the victim
+    chosen within the mask by the replacement manager. Lines remember
+    their owner, so evictions across tenants are counted.
+*/
+class TenantSim {
+public:
+    Cache* cache;
+    int nTenants;
+    vector<u64> rates;
+    vector<u64> wayMasks;   // ALL_WAYS for unpartitioned tenants
+    vector<vector<Instr> > instrs;
+    vector<TenantStats> stats;
+    vector<vector<u8> > logs;
+
+    TenantSim(Cache* cache, const vector<u64>& rates, const vector<u64>& wayMasks)
+    :
+        cache(cache),
+        nTenants(rates.size()),
+        rates(rates),
+        wayMasks(wayMasks),
+        instrs(rates.size()),
+        stats(rates.size()),
+        logs(rates.size())
+    {
+        assert(nTenants > 0 && nTenants <= MAX_TENANTS && wayMasks.size() == rates.size());
+        cache->keepLog = false;
+        cache->showProgress = false;
+    }
+
+    ~TenantSim() {
+        delete cache;
+    }
+
+    void addInstrs(int t, const vector<Instr>& trace) {
+        for (const Instr& instr : trace) {
+            instrs[t].push_back(Instr(instr.isread, instr.addr | (u64) t << TENANT_SHIFT));
+        }
+    }
+
+    // Tenant of every access of the interleaved stream
+    vector<u8> interleave() {
+        vector<u8> order;
+        vector<u64> next(nTenants, 0);
+        vector<i64> credit(nTenants, 0);
+        while (true) {
+            i64 total = 0;
+            int best = -1;
+            for (int t = 0; t < nTenants; ++t) {
+                if (next[t] == instrs[t].size()) continue;
+                credit[t] += rates[t];
+                total += rates[t];
+                if (best == -1 || credit[t] > credit[best]) best = t;
+            }
+            if (best == -1) break;
+            credit[best] -= total;
+            order.push_back(best);
+            next[best]++;
+        }
+        return order;
+    }
+
+    void run() {
+        vector<u8> order = interleave();
+        vector<Instr> merged;
+        vector<u64> next(nTenants, 0);
+        for (u8 t : order) {
+            merged.push_back(instrs[t][next[t]++]);
+        }
+
+        cache->beginTrace(merged);
+        for (u64 k = 0; k < merged.size(); ++k) {
+            access(order[k], merged[k]);
+        }
+        cache->endTrace();
+    }
+
+private:
+    FlatHashMap<u8> owners;     // Block -> tenant, for blocks in the cache
+
+    void access(int t, const Instr& instr) {
+        TenantStats& ts = stats[t];
+        u64 readBytes = cache->nReadBytes;
+        u64 writeBytes = cache->nWriteBytes;
+        cache->wayMask = wayMasks[t];
+        cache->lastEvicted = EMPTY_KEY;
+
+        u8 accessInfo = cache->processInstr(instr);
+
+        ts.nAccess++;
+        bool miss = !(accessInfo & LOG_HIT);
+        ts.nMiss += miss;
+        ts.nReadMiss += miss && instr.isread;
+        ts.nWriteMem += (accessInfo & LOG_WRITE_MEM) != 0;
+        ts.nReadMem += (accessInfo & LOG_REPLACE) != 0;
+        ts.nReadBytes += cache->nReadBytes - readBytes;
+        ts.nWriteBytes += cache->nWriteBytes - writeBytes;
+        logs[t].push_back(accessInfo);
+
+        if (accessInfo & LOG_REPLACE) {
+            if (cache->lastEvicted != EMPTY_KEY) {
+                u8* owner = owners.find(cache->lastEvicted);
+                assert(owner);
+                if (*owner != t) {
+                    stats[*owner].nEvictedByOthers++;
+                    ts.nEvictions++;
+                }
+                owners.erase(cache->lastEvicted);
+            }
+            owners.insert(instr.addr >> cache->lenOffset, t);
+        }
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+
+#include "global.hpp"
+
+using namespace std;
+
+/*
+    Work-stealing thread pool for independent jobs.
+
+    Jobs are dealt round-robin, in the given order, onto one deque per
+    worker. A worker runs jobs from the front of its own deque, and once
+    that is empty steals from the back of the others'. When jobs are given
+    longest first, every worker starts on one of the longest jobs and the
+    short tail is spread by stealing, so the total time approaches that of
+    the longest job.
+*/
+class WorkStealingPool {
+public:
+    int nThreads;
+
+    WorkStealingPool(int nThreads) : nThreads(nThreads > 0 ? nThreads : 1) {}
+
+    // Runs job(k) for every k in order, returns when all are done
+    void run(const vector<u64>& order, const function<void(u64)>& job) {
+        vector<deque<u64> > queues(nThreads);
+        vector<mutex> locks(nThreads);
+        for (u64 k = 0; k < order.size(); ++k) {
+            queues[k % nThreads].push_back(order[k]);
+        }
+
+        vector<thread> workers;
+        for (int w = 0; w < nThreads; ++w) {
+            workers.push_back(thread([&, w] {
+                u64 k;
+                while (takeOwn(queues[w], locks[w], k) || steal(queues, locks, w, k)) {
+                    job(k);
+                }
+            }));
+        }
+        for (thread& t : workers) t.join();
+    }
+
+private:
+    static bool takeOwn(deque<u64>& queue, mutex& lock, u64& k) {
+        lock_guard<mutex> guard(lock);
+        if (queue.empty()) return false;
+        k = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    bool steal(vector<deque<u64> >& queues, vector<mutex>& locks, int self, u64& k) {
+        for (int i = 1; i < nThreads; ++i) {
+            int victim = (self + i) % nThreads;
+            lock_guard<mutex> guard(locks[victim]);
+            if (!queues[victim].empty()) {
+                k = queues[victim].back();
+                queues[victim].pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
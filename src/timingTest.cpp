@@ -0,0 +1,46 @@
+/*
+    Checks of the timing models (`make test`): every byte an access moves
+    is put on the bus once, sized by what actually moves.
+*/
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "cache.hpp"
+
+static int nFailed = 0;
+
+// Bus cycles taken by the accesses, at one byte per cycle and no latency
+static double busCycles(WritePolicy writePolicy, Prefetcher* prefetcher,
+                        const vector<Instr>& instrs) {
+    Cache cache(64, 4, LRU, writePolicy);
+    cache.latency = new LatencyModel(0, 0, 0, 1);
+    if (prefetcher) {
+        cache.prefetcher = prefetcher;
+        cache.prefetcher->init(cache.nBlocks);
+    }
+    cache.processInstrs(instrs);
+    return cache.latency->memFreeAt;
+}
+
+static void expectBus(const char* what, double cycles, double expected) {
+    if (cycles != expected) {
+        printf("FAIL: %s took the bus for %.0f cycles, expected %.0f\n", what, cycles, expected);
+        nFailed++;
+    }
+}
+
+int main() {
+    vector<Instr> readMiss = { Instr(true, 0x1000) };
+    expectBus("a read miss", busCycles(back_alloc, nullptr, readMiss), 64);
+    expectBus("a read miss and a next-line prefetch",
+              busCycles(back_alloc, new PFNextLine(1), readMiss), 128);
+
+    // Write-through writes move one word, not the block
+    vector<Instr> writes = { Instr(true, 0x1000), Instr(false, 0x1000), Instr(false, 0x1004) };
+    expectBus("a read miss and two write-through writes",
+              busCycles(through_alloc, nullptr, writes), 64 + 2 * WORD_SIZE);
+
+    if (nFailed == 0) printf("timing tests OK\n");
+    return nFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cassert>
+
+#include "global.hpp"
+#include "utils.hpp"
+#include "instr.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+enum PageAlloc { allocSequential, allocRandom, allocColor, allocNull };
+
+const u64 PHYS_ADDR_LEN = 40;   // 1TB of physical memory to place pages in
+const u64 TLB_L2_WAYS = 8;
+
+/*
+    One level of a TLB: set-associative with LRU replacement, entries hold
+    virtual page numbers. Levels with fewer entries than TLB_L2_WAYS are
+    fully associative.
+*/
+class TlbLevel {
+public:
+    u64 nEntries;
+    u64 nWays;
+    u64 nSets;
+    vector<u64> vpns;
+    vector<u32> stamps;     // Time of last use, for LRU
+    u32 clock = 0;
+
+    TlbLevel(u64 nEntries, u64 nWays)
+    :
+        nEntries(nEntries),
+        nWays(nWays < nEntries ? nWays : nEntries),
+        vpns(nEntries, EMPTY_KEY),
+        stamps(nEntries, 0)
+    {
+        nSets = nEntries / this->nWays;
+        assert(nSets * this->nWays == nEntries && (nSets & (nSets - 1)) == 0);
+    }
+
+    bool lookup(u64 vpn) {
+        u64 base = (vpn & (nSets - 1)) * nWays;
+        for (u64 i = base; i < base + nWays; ++i) {
+            if (vpns[i] == vpn) {
+                stamps[i] = ++clock;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Fills an empty entry of the set, else the least recently used one
+    void insert(u64 vpn) {
+        u64 base = (vpn & (nSets - 1)) * nWays;
+        u64 victim = base;
+        for (u64 i = base; i < base + nWays; ++i) {
+            if (vpns[i] == EMPTY_KEY) {
+                victim = i;
+                break;
+            }
+            if (stamps[i] < stamps[victim]) victim = i;
+        }
+        vpns[victim] = vpn;
+        stamps[victim] = ++clock;
+    }
+};
+
+/*
+    Address translation in front of a physically indexed cache.
+
+    Every access looks up its virtual page in a small fully associative L1
+    TLB, then an 8-way L2 TLB; a miss in both walks the page table, one
+    memory reference per level (4 levels for 4KB pages, 3 for 2MB, 2 for
+    1GB). Physical frames are handed out on first touch, deterministically:
+        sequential  frames in order of first touch
+        random      frames drawn from a fixed-seed generator
+        color       the next free frame whose cache colour (the set index
+                    bits above the page offset) matches the virtual page's,
+                    so the cache sees the same set mapping as without
+                    translation
+    Translation does not depend on the cache, so a whole trace is
+    translated before the cache runs (which keeps OPT's view of the future
+    physical too).
+*/
+class Tlb {
+public:
+    u64 pageSize;
+    u64 lenPage;
+    PageAlloc alloc;
+    u64 nColors;
+    u64 walkLevels;
+
+    TlbLevel l1;
+    TlbLevel l2;
+    FlatHashMap<u64> pageTable;     // Virtual page -> physical frame
+
+    // stats
+    u64 nAccess = 0;
+    u64 nL1Miss = 0;
+    u64 nWalks = 0;         // L2 misses
+    u64 nWalkRefs = 0;      // Memory references made by page walks
+
+    // colorBytes is the cache size divided by its associativity, the span
+    // of addresses over which set indices repeat
+    Tlb(u64 l1Entries, u64 l2Entries, u64 pageSize, PageAlloc alloc, u64 colorBytes)
+    :
+        pageSize(pageSize),
+        alloc(alloc),
+        l1(l1Entries, l1Entries),
+        l2(l2Entries, TLB_L2_WAYS)
+    {
+        lenPage = log2u(pageSize);
+        assert(1ull << lenPage == pageSize && lenPage < PHYS_ADDR_LEN);
+        nColors = colorBytes > pageSize ? colorBytes / pageSize : 1;
+        walkLevels = (48 - lenPage) / 9;
+        nextOfColor.assign(nColors, 0);
+    }
+
+    u64 translate(u64 addr) {
+        nAccess++;
+        u64 vpn = addr >> lenPage;
+        if (!l1.lookup(vpn)) {
+            nL1Miss++;
+            if (!l2.lookup(vpn)) {
+                nWalks++;
+                nWalkRefs += walkLevels;
+                l2.insert(vpn);
+            }
+            l1.insert(vpn);
+        }
+        u64* frame = pageTable.find(vpn);
+        u64 pfn = frame ? *frame : allocFrame(vpn);
+        return (pfn << lenPage) | (addr & (pageSize - 1));
+    }
+
+    void translate(vector<Instr>& instrs) {
+        for (Instr& instr : instrs) {
+            instr.addr = translate(instr.addr);
+        }
+    }
+
+    // Pages stay mapped and the TLBs keep their entries
+    void resetStats() {
+        nAccess = nL1Miss = nWalks = nWalkRefs = 0;
+    }
+
+    u64 getNPages() const {
+        return pageTable.size();
+    }
+
+private:
+    u64 nextFrame = 0;
+    vector<u64> nextOfColor;    // Per colour, frames of it handed out
+    FlatHashMap<u8> usedFrames; // Random allocation only
+    u64 rngState = 0x2545f4914f6cdd1dull;
+
+    u64 allocFrame(u64 vpn) {
+        u64 nFrames = 1ull << (PHYS_ADDR_LEN - lenPage);
+        assert(pageTable.size() < nFrames);
+        u64 pfn;
+        if (alloc == allocSequential) {
+            pfn = nextFrame++;
+        } else if (alloc == allocRandom) {
+            do {
+                rngState += 0x9e3779b97f4a7c15ull;
+                pfn = hashU64(rngState) & (nFrames - 1);
+            } while (usedFrames.contains(pfn));
+            usedFrames.insert(pfn, 1);
+        } else {
+            u64 color = vpn % nColors;
+            pfn = nextOfColor[color]++ * nColors + color;
+            assert(pfn < nFrames);
+        }
+        pageTable.insert(vpn, pfn);
+        return pfn;
+    }
+};
+
+PageAlloc sToAlloc(const string& str) {
+    if (str == "seq") return allocSequential;
+    if (str == "random") return allocRandom;
+    if (str == "color") return allocColor;
+    return allocNull;
+}
+
+// "4k", "2m" or "1g", 0 if invalid
+u64 sToPageSize(const string& str) {
+    if (str == "4k") return 4ull << 10;
+    if (str == "2m") return 2ull << 20;
+    if (str == "1g") return 1ull << 30;
+    return 0;
+}
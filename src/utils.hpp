@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <cassert>
 #include "global.hpp"
 
@@ -18,6 +19,17 @@ u64 toBin(string s) {
     return res;
 }
 
+vector<string> split(const string& s, char sep) {
+    vector<string> parts;
+    size_t start = 0, pos;
+    while ((pos = s.find(sep, start)) != string::npos) {
+        parts.push_back(s.substr(start, pos - start));
+        start = pos + 1;
+    }
+    parts.push_back(s.substr(start));
+    return parts;
+}
+
 u64 getBits(u64 bits, u64 lo, u64 len) {
     assert(len < 64ll);
     bits >>= lo;
@@ -103,6 +115,59 @@ inline bool isWriteAlloc(WritePolicy policy) {
     return policy == through_alloc || policy == back_alloc;
 }
 
+ReplacementPolicy sToReplace(const char* s) {
+    string str(s);
+    if (str == "binTree") return binTree;
+    if (str == "LRU") return LRU;
+    if (str == "PLRU") return PLRU;
+    if (str == "OPT") return OPT;
+
+    return replaceNull;
+}
+
+WritePolicy sToWrite(const char* s) {
+    string str(s);
+    if (str == "back_alloc") return back_alloc;
+    if (str == "back_noAlloc") return back_noAlloc;
+    if (str == "through_alloc") return through_alloc;
+    if (str == "through_noAlloc") return through_noAlloc;
+    return writeNull;
+}
+
+string replaceToS(ReplacementPolicy policy) {
+    if (policy == binTree) return "binTree";
+    if (policy == LRU) return "LRU";
+    if (policy == PLRU) return "PLRU";
+    if (policy == OPT) return "OPT";
+    return "replaceNull";
+}
+
+string writeToS(WritePolicy policy) {
+    if (policy == back_alloc) return "back_alloc";
+    if (policy == back_noAlloc) return "back_noAlloc";
+    if (policy == through_alloc) return "through_alloc";
+    if (policy == through_noAlloc) return "through_noAlloc";
+    return "writeNull";
+}
+
+// The policy with the same allocation but the other write hit behaviour
+WritePolicy toggleWriteHit(WritePolicy policy) {
+    if (policy == back_alloc) return through_alloc;
+    if (policy == back_noAlloc) return through_noAlloc;
+    if (policy == through_alloc) return back_alloc;
+    if (policy == through_noAlloc) return back_noAlloc;
+    return writeNull;
+}
+
+IndexFunction sToIndex(const char* s) {
+    string str(s);
+    if (str == "bits") return indexBits;
+    if (str == "xor") return indexXor;
+    if (str == "prime") return indexPrime;
+    if (str == "skew") return indexSkew;
+    return indexNull;
+}
+
 void printBin(u64 n) {
     for (int i = 0; i < 64; ++i) {
         cout << (1 & n);
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <vector>
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#include <unordered_map>
+
+#include "global.hpp"
+#include "utils.hpp"
+#include "instr.hpp"
+#include "cache.hpp"
+
+using namespace std;
+
+/*
+    Reference model of Cache, used by --verify as a shadow of the real one.
+
+    Written for obviousness instead of speed: a plain struct per line, a
+    hash map from block to way for lookups, and the replacement state of
+    every set unpacked into a vector, laid out as
+    ReplacementManager::getSetState reports it. It follows the behaviour of
+    Cache with the binTree, LRU and PLRU managers, including the quirks
+    that results depend on: a read miss hands the tree the unresolved -1
+    way, a write miss resolves it first, and a set counts as filled when
+    its last way is filled while invalid (or, fully associative, when every
+    line is valid). None of the bit packing is shared.
+*/
+struct RefLine {
+    bool valid = false;
+    bool dirty = false;
+    u64 block = 0;
+};
+
+class RefCache {
+public:
+    u64 nBlocks;
+    u64 nWays;
+    u64 nSets;
+    u64 lenOffset;
+    ReplacementPolicy replacementPolicy;
+    WritePolicy writePolicy;
+
+    vector<RefLine> lines;
+    vector<vector<u64> > rmState;
+    unordered_map<u64, u64> wayOf;  // Block of every valid line -> way
+
+    // Line touched by the latest access, lastWay == nWays if none
+    u64 lastSet = 0;
+    u64 lastWay = 0;
+
+    RefCache(u64 blockSize, u64 numWays, ReplacementPolicy replacementPolicy, WritePolicy writePolicy)
+    :
+        replacementPolicy(replacementPolicy),
+        writePolicy(writePolicy)
+    {
+        assert(replacementPolicy == binTree || replacementPolicy == LRU || replacementPolicy == PLRU);
+        nBlocks = CACHE_SIZE / blockSize;
+        nWays = numWays == 0 ? nBlocks : numWays;
+        nSets = nBlocks / nWays;
+        lenOffset = log2u(blockSize);
+        lines.resize(nBlocks);
+        rmState.assign(nSets, initialState());
+    }
+
+    RefLine& line(u64 set, u64 way) {
+        return lines[set * nWays + way];
+    }
+
+    u8 access(const Instr& instr) {
+        u64 block = instr.addr >> lenOffset;
+        u64 set = block & (nSets - 1);
+        lastSet = set;
+        lastWay = nWays;
+
+        u8 accessInfo = 0;
+        auto it = wayOf.find(block);
+        if (it != wayOf.end()) {
+            accessInfo |= LOG_HIT;
+            lastWay = it->second;
+            onAccess(set, lastWay);
+        } else if (instr.isread || isWriteAlloc(writePolicy)) {
+            accessInfo |= LOG_REPLACE;
+            i64 way = getReplacement(set);
+            if (way == -1 && !instr.isread) {
+                way = findInvalid(set);
+            }
+            lastWay = fill(set, way, block, accessInfo);
+            onAccess(set, (u64) way);
+        } else {
+            return LOG_WRITE_MEM;
+        }
+
+        if (!instr.isread) {
+            if (isWriteBack(writePolicy)) {
+                line(set, lastWay).dirty = true;
+            } else {
+                accessInfo |= LOG_WRITE_MEM;
+            }
+        }
+        return accessInfo;
+    }
+
+    // Takes over the whole state of cache, which must have the same shape
+    void loadFrom(Cache& cache) {
+        assert(cache.nWays == nWays && cache.nSets == nSets);
+        wayOf.clear();
+        for (u64 set = 0; set < nSets; ++set) {
+            for (u64 way = 0; way < nWays; ++way) {
+                RefLine& l = line(set, way);
+                u8* cacheLine = cache.at(set, way);
+                l.valid = cache.isValid(cacheLine);
+                l.dirty = l.valid && isWriteBack(writePolicy) && cache.isDirty(cacheLine);
+                l.block = l.valid ? cache.getBlock(cache.getLineTag(cacheLine), set) : 0;
+                if (l.valid) wayOf[l.block] = way;
+            }
+            rmState[set] = cache.rm->getSetState(set);
+        }
+    }
+
+private:
+    vector<u64> initialState() {
+        vector<u64> state;
+        if (nWays == 1) return state;
+        if (replacementPolicy == binTree) {
+            state.assign(nWays, 0);
+            return state;
+        }
+        for (u64 way = 0; way < nWays; ++way) {
+            state.push_back(way);
+        }
+        if (replacementPolicy == PLRU) {
+            state.resize(2 * nWays, 0);
+        }
+        return state;
+    }
+
+    u64 findInvalid(u64 set) {
+        for (u64 way = 0; way < nWays; ++way) {
+            if (!line(set, way).valid) return way;
+        }
+        assert(false);
+        return nWays;
+    }
+
+    // Returns the way filled, way == -1 meaning the first invalid one
+    u64 fill(u64 set, i64 way, u64 block, u8& accessInfo) {
+        bool replacingInvalid = way == -1 || !line(set, way).valid;
+        if (way == -1) way = findInvalid(set);
+        RefLine& l = line(set, way);
+        if (l.valid) {
+            if (isWriteBack(writePolicy) && l.dirty) accessInfo |= LOG_WRITE_MEM;
+            wayOf.erase(l.block);
+        }
+        l.valid = true;
+        l.dirty = false;
+        l.block = block;
+        wayOf[block] = way;
+
+        if ((replacingInvalid && (u64) way == nWays - 1) || (nSets == 1 && wayOf.size() == nWays)) {
+            onSetFilled(set);
+        }
+        return way;
+    }
+
+    void onAccess(u64 set, u64 way) {
+        if (nWays == 1) return;
+        vector<u64>& state = rmState[set];
+        if (replacementPolicy == binTree) {
+            // Each node on the path points away from the accessed half
+            u64 range = nWays;
+            u64 node = 1;
+            while (range > 1) {
+                u64 half = range / 2;
+                bool lower = way % range < half;
+                range = half;
+                state[node] = lower;
+                node = lower ? 2 * node : 2 * node + 1;
+            }
+            return;
+        }
+        u64 pos = 0;
+        while (state[pos] != way) pos++;
+        state.erase(state.begin() + pos);
+        state.insert(state.begin() + nWays - 1, way);
+        if (replacementPolicy == PLRU) {
+            state[nWays + way] = (state[nWays + way] + 1) & 7;
+        }
+    }
+
+    i64 getReplacement(u64 set) {
+        if (nWays == 1) return 0;
+        vector<u64>& state = rmState[set];
+        if (replacementPolicy == binTree) {
+            if (state[0] == 0) return -1;
+            u64 stride = nWays;
+            u64 node = 1;
+            i64 way = 0;
+            while (stride > 1) {
+                stride /= 2;
+                if (state[node]) {
+                    way += stride;
+                    node = 2 * node + 1;
+                } else {
+                    node = 2 * node;
+                }
+            }
+            return way;
+        }
+        if (replacementPolicy == LRU) {
+            return state[0];
+        }
+        // PLRU: the least recent way whose counter is not among the
+        // nWays / 4 largest
+        vector<u64> counts(state.begin() + nWays, state.end());
+        sort(counts.begin(), counts.end());
+        u64 maxCount = counts[nWays - 1 - nWays / 4];
+        for (u64 pos = 0; pos < nWays; ++pos) {
+            if (state[nWays + state[pos]] <= maxCount) return state[pos];
+        }
+        assert(false);
+        return 0;
+    }
+
+    void onSetFilled(u64 set) {
+        if (replacementPolicy == binTree && nWays > 1) rmState[set][0] = 1;
+    }
+};
+
+/*
+    Differential testing: runs a trace through a Cache with the reference
+    model alongside, and stops at the first access where the access
+    information, a line of the accessed set, or its replacement state
+    differ, printing both versions of the set.
+
+    With period == 0 the reference runs in lockstep over the whole trace.
+    Otherwise it is loaded from the cache every period accesses and checked
+    for the first window accesses after that, which keeps long traces and
+    large caches cheap. Sets of more than FULL_CHECK_WAYS ways (fully
+    associative caches) only have the accessed line checked per access,
+    and are compared in full at the end of each window.
+*/
+const u64 FULL_CHECK_WAYS = 64;
+
+class Verifier {
+public:
+    RefCache ref;
+    u64 window;
+    u64 period;
+
+    u64 nChecked = 0;   // Accesses compared with the reference
+
+    Verifier(Cache& cache, u64 window = 0, u64 period = 0)
+    :
+        ref(cache.blockSize, cache.nWays, cache.replacementPolicy, cache.writePolicy),
+        window(window),
+        period(period)
+    {
+        assert(period == 0 || (window > 0 && window <= period));
+    }
+
+    // Like Cache::processInstrs, returns false on a divergence
+    bool run(Cache& cache, const vector<Instr>& instrs) {
+        cache.beginTrace(instrs);
+        bool checking = (period == 0);
+        if (checking) {
+            // The cache may have been warmed up
+            ref.loadFrom(cache);
+        }
+        for (u64 k = 0; k < instrs.size(); ++k) {
+            if (period > 0 && k % period == window && checking) {
+                checking = false;
+                if (!compareAll(cache, k)) return false;
+            }
+            if (period > 0 && k % period == 0) {
+                ref.loadFrom(cache);
+                checking = true;
+            }
+
+            u8 accessInfo = cache.processInstr(instrs[k]);
+            if (!checking) continue;
+            u8 refInfo = ref.access(instrs[k]);
+            nChecked++;
+            u64 set = ref.lastSet;
+            bool same = accessInfo == refInfo;
+            if (ref.nWays <= FULL_CHECK_WAYS) {
+                for (u64 way = 0; way < ref.nWays && same; ++way) {
+                    same = sameLine(cache, set, way);
+                }
+                same = same && cache.rm->getSetState(set) == ref.rmState[set];
+            } else if (ref.lastWay < ref.nWays) {
+                same = same && sameLine(cache, set, ref.lastWay);
+            }
+            if (!same) {
+                printf("verify: divergence at access %llu (%c 0x%llx), access info 0x%x, reference 0x%x\n",
+                       k, instrs[k].isread ? 'r' : 'w', instrs[k].addr, accessInfo, refInfo);
+                dumpSet(cache, set);
+                return false;
+            }
+        }
+        if (checking && !compareAll(cache, instrs.size())) return false;
+        cache.endTrace();
+        return true;
+    }
+
+private:
+    bool sameLine(Cache& cache, u64 set, u64 way) {
+        u8* line = cache.at(set, way);
+        const RefLine& l = ref.line(set, way);
+        if (cache.isValid(line) != l.valid) return false;
+        if (!l.valid) return true;
+        bool dirty = isWriteBack(cache.writePolicy) && cache.isDirty(line);
+        return dirty == l.dirty && cache.getBlock(cache.getLineTag(line), set) == l.block;
+    }
+
+    bool compareAll(Cache& cache, u64 k) {
+        for (u64 set = 0; set < ref.nSets; ++set) {
+            bool same = cache.rm->getSetState(set) == ref.rmState[set];
+            for (u64 way = 0; way < ref.nWays && same; ++way) {
+                same = sameLine(cache, set, way);
+            }
+            if (!same) {
+                printf("verify: divergence found before access %llu\n", k);
+                dumpSet(cache, set);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Large sets only show the lines that differ and the accessed one
+    void dumpSet(Cache& cache, u64 set) {
+        printf("set %llu (%llu ways)\n", set, ref.nWays);
+        printf("  way   cache: V D block        reference: V D block\n");
+        for (u64 way = 0; way < ref.nWays; ++way) {
+            bool same = sameLine(cache, set, way);
+            if (ref.nWays > FULL_CHECK_WAYS && same && !(set == ref.lastSet && way == ref.lastWay)) {
+                continue;
+            }
+            u8* line = cache.at(set, way);
+            bool valid = cache.isValid(line);
+            bool dirty = isWriteBack(cache.writePolicy) && cache.isDirty(line);
+            u64 block = valid ? cache.getBlock(cache.getLineTag(line), set) : 0;
+            const RefLine& l = ref.line(set, way);
+            printf("%c %4llu          %u %u %-12llx            %u %u %llx\n",
+                   same ? ' ' : '*', way, valid, dirty, block, l.valid, l.dirty, l.block);
+        }
+        printStates(cache.rm->getSetState(set), ref.rmState[set]);
+    }
+
+    // Long states (fully associative) only show the entries that differ
+    void printStates(const vector<u64>& state, const vector<u64>& refState) {
+        if (state.size() <= 2 * FULL_CHECK_WAYS && refState.size() <= 2 * FULL_CHECK_WAYS) {
+            printf("  replacement state, cache:    ");
+            for (u64 v : state) printf(" %llu", v);
+            printf("\n  replacement state, reference:");
+            for (u64 v : refState) printf(" %llu", v);
+            printf("\n");
+            return;
+        }
+        printf("  replacement state entries that differ (entry: cache reference):");
+        for (u64 i = 0; i < state.size() && i < refState.size(); ++i) {
+            if (state[i] != refState[i]) printf(" %llu: %llu %llu", i, state[i], refState[i]);
+        }
+        printf("\n");
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include "global.hpp"
+#include "flatHash.hpp"
+
+using namespace std;
+
+/*
+    Small fully-associative victim cache behind the main cache, holding
+    lines evicted by Cache::replace() together with their dirty bit.
+
+    Probes go through a FlatHashMap from block to slot, so a main-cache miss
+    costs O(1) here. The LRU entry is only searched for when inserting into
+    a full victim cache, which is a scan over at most a few dozen entries.
+*/
+class VictimCache {
+public:
+    u64 nEntries;
+    vector<u64> blocks;
+    vector<u8> dirty;
+    vector<u64> lastUse;
+    vector<u32> freeSlots;
+    FlatHashMap<u32> slots;
+    u64 time = 0;
+
+    u64 nHits = 0;
+    u64 nDeferred = 0;      // Dirty lines whose writeback was deferred
+    u64 nWritebacks = 0;    // Dirty lines written back when dropped
+    u64 nSaved = 0;         // Deferred writebacks avoided by a victim hit
+
+    VictimCache(u64 nEntries)
+    :
+        nEntries(nEntries),
+        blocks(nEntries),
+        dirty(nEntries, 0),
+        lastUse(nEntries, 0),
+        slots(nEntries)
+    {
+        assert(nEntries > 0);
+        for (u64 i = nEntries; i-- > 0; ) {
+            freeSlots.push_back((u32) i);
+        }
+    }
+
+    // Removes block on a hit so it can be swapped back into the main cache
+    bool take(u64 block, bool& wasDirty) {
+        if (!remove(block, wasDirty)) return false;
+        nSaved += wasDirty;
+        nHits++;
+        return true;
+    }
+
+    // Removes block without counting a hit, for prefetches that move it
+    // back into the main cache with its dirty bit
+    bool remove(u64 block, bool& wasDirty) {
+        u32* slot = slots.find(block);
+        if (slot == nullptr) return false;
+        u32 s = *slot;
+        wasDirty = dirty[s];
+        slots.erase(block);
+        freeSlots.push_back(s);
+        return true;
+    }
+
+    // Writes to a block held here (no-write-allocate write misses). Only
+    // a write-back write is absorbed and counts as a hit; a write-through
+    // write still goes to memory.
+    bool write(u64 block, bool makeDirty) {
+        u32* slot = slots.find(block);
+        if (slot == nullptr) return false;
+        if (makeDirty && !dirty[*slot]) {
+            dirty[*slot] = 1;
+            nDeferred++;
+        }
+        lastUse[*slot] = ++time;
+        nHits += makeDirty;
+        return true;
+    }
+
+    // Inserts an evicted line. Returns the dirty block that had to be
+    // written back to make room, or EMPTY_KEY if none.
+    u64 insert(u64 block, bool isDirty) {
+        u32* present = slots.find(block);
+        if (present != nullptr) {
+            // Cannot happen while the main cache and this one are
+            // exclusive, but a second slot would orphan the first
+            u32 s = *present;
+            nDeferred += isDirty && !dirty[s];
+            dirty[s] |= isDirty;
+            lastUse[s] = ++time;
+            return EMPTY_KEY;
+        }
+        u64 written = EMPTY_KEY;
+        u32 s;
+        if (!freeSlots.empty()) {
+            s = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            s = 0;
+            for (u32 i = 1; i < nEntries; ++i) {
+                if (lastUse[i] < lastUse[s]) s = i;
+            }
+            if (dirty[s]) {
+                written = blocks[s];
+                nWritebacks++;
+            }
+            slots.erase(blocks[s]);
+        }
+        blocks[s] = block;
+        dirty[s] = isDirty;
+        lastUse[s] = ++time;
+        nDeferred += isDirty;
+        slots.insert(block, s);
+        return written;
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+#include <iostream>
+#include <fstream>
+
+#include "global.hpp"
+
+using namespace std;
+
+/*
+    Time series of cache statistics, one record every window of accesses,
+    built from counters that are bumped once per access.
+
+    With a fixed schedule every window is windowLen accesses long. With the
+    adaptive schedule a window doubles in length (up to 64 times the base)
+    after each window that stays in the same phase, and falls back to the
+    base length when a phase change is detected, so stable stretches of a
+    trace take few records and transitions are seen at full resolution.
+
+    Phase detection compares the feature vector of each window (miss rate,
+    write fraction, memory writes and memory reads per access) with an
+    exponential moving average of the previous windows of the phase. A
+    window whose L1 distance exceeds both an absolute threshold and 4 times
+    the running average distance starts a new phase.
+*/
+const char WINDOW_MAGIC[8] = { 'C', 'S', 'W', 'I', 'N', 'D', '1', '\0' };
+const int N_WINDOW_FEATURES = 4;
+const int MAX_WINDOW_SCALE = 64;
+
+class WindowStats {
+public:
+    u64 windowLen;
+    bool adaptive;
+    double threshold;
+
+    // Counters of the current window
+    u64 curLen;
+    u64 nAccess = 0;
+    u64 nWrite = 0;
+    u64 nMiss = 0;
+    u64 nWriteMem = 0;
+    u64 nReadMem = 0;
+
+    // One entry per finished window, stored as columns
+    vector<u32> lengths;
+    vector<u32> writes;
+    vector<u32> misses;
+    vector<u32> writeMems;
+    vector<u32> readMems;
+    vector<u8> phaseStart;
+
+    u64 nPhases = 0;
+
+    WindowStats(u64 windowLen, bool adaptive, double threshold = 0.05)
+    :
+        windowLen(windowLen),
+        adaptive(adaptive),
+        threshold(threshold),
+        curLen(windowLen)
+    {
+        assert(windowLen > 0 && windowLen * MAX_WINDOW_SCALE <= 0xffffffffull);
+    }
+
+    inline void onAccess(bool isread, u8 accessInfo) {
+        nAccess++;
+        nWrite += !isread;
+        nMiss += !(accessInfo & LOG_HIT);
+        nWriteMem += (accessInfo & LOG_WRITE_MEM) != 0;
+        nReadMem += (accessInfo & LOG_REPLACE) != 0;
+        if (nAccess == curLen) {
+            endWindow();
+        }
+    }
+
+    // Closes the last, possibly partial, window
+    void finish() {
+        if (nAccess > 0) endWindow();
+    }
+
+    u64 size() const {
+        return lengths.size();
+    }
+
+    /*
+        Binary columnar layout, little endian:
+            8 bytes   magic "CSWIND1\0"
+            u32       number of columns
+            u64       number of windows
+            per column: name terminated by '\0', type char ('I' = u32, 'B' = u8)
+            per column: all values of the column, contiguous
+    */
+    void writeColumns(string filename) {
+        ofstream fout(filename, ios::binary);
+        if (!fout.is_open()) {
+            printf("Error opening output file\n");
+            assert(false);
+        }
+        u32 nCols = 6;
+        u64 nRows = size();
+        fout.write(WINDOW_MAGIC, sizeof(WINDOW_MAGIC));
+        fout.write((char*) &nCols, sizeof(nCols));
+        fout.write((char*) &nRows, sizeof(nRows));
+        const char* header[] = { "length", "writes", "misses", "write mem", "read mem", "phase start" };
+        for (u32 i = 0; i < nCols; ++i) {
+            fout.write(header[i], strlen(header[i]) + 1);
+            fout.put(i + 1 < nCols ? 'I' : 'B');
+        }
+        for (vector<u32>* col : { &lengths, &writes, &misses, &writeMems, &readMems }) {
+            fout.write((char*) col->data(), col->size() * sizeof(u32));
+        }
+        fout.write((char*) phaseStart.data(), phaseStart.size());
+        cout << "Saved " << nRows << " windows to " << filename << endl;
+    }
+
+private:
+    double mean[N_WINDOW_FEATURES];
+    double meanDist = 0;
+    u64 nPhaseWindows = 0;  // Windows in the current phase
+
+    void endWindow() {
+        double n = (double) nAccess;
+        double features[N_WINDOW_FEATURES] = {
+            nMiss / n, nWrite / n, nWriteMem / n, nReadMem / n
+        };
+
+        bool newPhase = (nPhaseWindows == 0);
+        double dist = 0;
+        if (!newPhase) {
+            for (int f = 0; f < N_WINDOW_FEATURES; ++f) {
+                dist += fabs(features[f] - mean[f]);
+            }
+            // Needs a couple of windows before the distance average means much
+            newPhase = nPhaseWindows >= 2 && dist > threshold && dist > 4 * meanDist;
+        }
+
+        if (newPhase) {
+            nPhases++;
+            nPhaseWindows = 0;
+            meanDist = 0;
+            for (int f = 0; f < N_WINDOW_FEATURES; ++f) {
+                mean[f] = features[f];
+            }
+        } else {
+            const double alpha = 0.25;
+            for (int f = 0; f < N_WINDOW_FEATURES; ++f) {
+                mean[f] += alpha * (features[f] - mean[f]);
+            }
+            meanDist += alpha * (dist - meanDist);
+        }
+        nPhaseWindows++;
+
+        lengths.push_back((u32) nAccess);
+        writes.push_back((u32) nWrite);
+        misses.push_back((u32) nMiss);
+        writeMems.push_back((u32) nWriteMem);
+        readMems.push_back((u32) nReadMem);
+        phaseStart.push_back(newPhase);
+
+        if (adaptive) {
+            if (newPhase) {
+                curLen = windowLen;
+            } else if (curLen < windowLen * MAX_WINDOW_SCALE) {
+                curLen *= 2;
+            }
+        }
+        nAccess = nWrite = nMiss = nWriteMem = nReadMem = 0;
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+
+#include "global.hpp"
+
+using namespace std;
+
+enum DrainPolicy { drainFifo, drainThreshold, drainNull };
+
+/*
+    Coalescing write buffer between a write-through cache and memory.
+
+    Entries are whole blocks kept in FIFO order in a ring. A write to a
+    block already buffered is merged into its entry. Memory accepts one
+    buffered write every `drainInterval` accesses:
+    - drainFifo: retire the oldest entry whenever memory is free,
+    - drainThreshold: only retire once `threshold` entries are waiting,
+      which holds entries longer and coalesces more.
+    A write into a full buffer forces the oldest entry out (a stall).
+    Each entry remembers which words were written, so only those words
+    count towards the bytes written to memory, and a fill that misses in
+    the cache takes those words from the buffer instead of memory.
+*/
+class WriteBuffer {
+public:
+    u64 nEntries;
+    DrainPolicy policy;
+    u64 drainInterval;
+    u64 threshold;
+    u64 wordBytes;
+
+    vector<u64> blocks;
+    vector<u64> wordMasks;  // Per entry, bit w set if word w was written
+    u64 head = 0;
+    u64 count = 0;
+    u64 memFreeAt = 0;
+
+    u64 nWrites = 0;
+    u64 nCoalesced = 0;
+    u64 nIssued = 0;        // Writes issued to memory
+    u64 nIssuedBytes = 0;
+    u64 nFullStalls = 0;
+    u64 nReadHits = 0;
+
+    WriteBuffer(u64 nEntries, DrainPolicy policy, u64 drainInterval, u64 blockSize)
+    :
+        nEntries(nEntries),
+        policy(policy),
+        drainInterval(drainInterval),
+        threshold((nEntries + 1) / 2),
+        wordBytes(WORD_SIZE < blockSize ? WORD_SIZE : blockSize),
+        blocks(nEntries),
+        wordMasks(nEntries, 0)
+    {
+        assert(nEntries > 0);
+        assert(blockSize / wordBytes <= 64);
+    }
+
+    bool contains(u64 block) const {
+        return find(block) != nEntries;
+    }
+
+    // Lets memory retire buffered writes, called once per access
+    void tick(u64 now) {
+        if (count == 0 || now < memFreeAt) return;
+        if (policy == drainThreshold && count < threshold) return;
+        retire(now);
+    }
+
+    void write(u64 block, u64 word, u64 now) {
+        nWrites++;
+        u64 slot = find(block);
+        if (slot != nEntries) {
+            wordMasks[slot] |= 1ull << word;
+            nCoalesced++;
+            return;
+        }
+        if (count == nEntries) {
+            nFullStalls++;
+            retire(now);
+        }
+        slot = (head + count) % nEntries;
+        blocks[slot] = block;
+        wordMasks[slot] = 1ull << word;
+        count++;
+    }
+
+    // Bytes of [begin, begin + size) within block that the buffer holds
+    // and forwards to a fill, the rest comes from memory
+    u64 read(u64 block, u64 begin, u64 size) {
+        u64 slot = find(block);
+        if (slot == nEntries) return 0;
+        u64 end = begin + size;
+        u64 bytes = 0;
+        for (u64 mask = wordMasks[slot]; mask != 0; mask &= mask - 1) {
+            u64 wordBegin = __builtin_ctzll(mask) * wordBytes;
+            u64 lo = wordBegin > begin ? wordBegin : begin;
+            u64 hi = wordBegin + wordBytes < end ? wordBegin + wordBytes : end;
+            if (lo < hi) bytes += hi - lo;
+        }
+        nReadHits += bytes > 0;
+        return bytes;
+    }
+
+    // Drains everything at the end of the trace
+    void flush() {
+        for (u64 i = 0; i < count; ++i) {
+            nIssuedBytes += __builtin_popcountll(wordMasks[(head + i) % nEntries]) * wordBytes;
+        }
+        nIssued += count;
+        head = 0;
+        count = 0;
+    }
+
+private:
+    // Slot holding block, or nEntries if it is not buffered
+    u64 find(u64 block) const {
+        for (u64 i = 0; i < count; ++i) {
+            u64 slot = (head + i) % nEntries;
+            if (blocks[slot] == block) return slot;
+        }
+        return nEntries;
+    }
+
+    void retire(u64 now) {
+        nIssuedBytes += __builtin_popcountll(wordMasks[head]) * wordBytes;
+        head = (head + 1) % nEntries;
+        count--;
+        nIssued++;
+        memFreeAt = (now > memFreeAt ? now : memFreeAt) + drainInterval;
+    }
+};
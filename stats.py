@@ -1,10 +1,12 @@
 import os
 from matplotlib import pyplot as plt
 
+import query
+
 block_sizes = [8, 32, 64]
 assocs = [1, 4, 8, 0]
 write_policies = ["back_alloc", "back_noAlloc", "through_alloc", "through_noAlloc"]
-replace_policies = ['binTree', 'LRU', 'PLRU']
+replace_policies = ['binTree', 'LRU', 'PLRU', 'OPT']
 
 default_rp = replace_policies[0]
 default_write = write_policies[0]
@@ -23,7 +25,20 @@ def get_avg(lis):
     return sum(lis) / len(lis)
 
 
+store_rows = None
+
+
 def read_stats(blocksize, ways, replace, write):
+    # The result store when it has rows for the config (read once), else
+    # the TSV export, e.g. for configs run before the store existed
+    global store_rows
+    if store_rows is None:
+        store_rows = query.read_store() if os.path.exists(query.default_db) else []
+    config = f"{blocksize} {ways} {replace} {write}"
+    data = [row for row in store_rows if row["config"] == config]
+    if data:
+        return sorted(data, key=lambda row: row["trace id"])
+
     filename = get_filename(blocksize, ways, replace, write)
     filename = os.path.join(in_dir, filename)
     lines = []
@@ -42,7 +57,7 @@ def read_stats(blocksize, ways, replace, write):
 def get_miss_rate(stats):
     row_data = []
     for i in range(4):
-        mr = stats[i]['miss rate']
+        mr = round(stats[i]['miss rate'], 1)
         row_data.append(mr)
     row_data.append(f'{get_avg(row_data):.1f}')
     return row_data